@@ -19,19 +19,69 @@ http://creativecommons.org/publicdomain/zero/1.0/
 #endif
 
 int InitDuplex(duplexState *state, unsigned int rate, unsigned int capacity)
+{
+    return InitDuplexRounds(state, rate, capacity, 24);
+}
+
+int InitDuplexRounds(duplexState *state, unsigned int rate, unsigned int capacity, unsigned int rounds)
 {
     if (rate+capacity != 1600)
         return 1;
     if ((rate <= 0) || (rate > 1600))
         return 1;
-    KeccakInitialize();
+    if ((rounds != 12) && (rounds != 24))
+        return 1;
     state->rate = rate;
     state->capacity = capacity;
     state->rho_max = rate-2;
+    state->rounds = rounds;
     KeccakInitializeState(state->state);
     return 0;
 }
 
+static void DuplexAbsorb(duplexState *state, const unsigned char *block, unsigned int laneCount)
+{
+    if (state->rounds == 24)
+        KeccakAbsorb(state->state, block, laneCount);
+    else
+        KeccakAbsorbRounds(state->state, block, laneCount, state->rounds);
+}
+
+int DuplexingSqueeze(duplexState *state, unsigned char *out, unsigned long long outBitLen)
+{
+    ALIGN unsigned char block[KeccakPermutationSizeInBytes];
+    ALIGN unsigned char buffer[KeccakPermutationSizeInBytes];
+    unsigned int laneCount = state->rate/64;
+
+    if ((state->rate % 64) != 0) {
+        for( ; outBitLen > state->rate; outBitLen -= state->rate, out += state->rate/8) {
+            if (Duplexing(state, NULL, 0, out, state->rate) != 0)
+                return 1;
+        }
+        return Duplexing(state, NULL, 0, out, (unsigned int)outBitLen);
+    }
+
+    // Padded empty input, the same for every block
+    memset(block, 0, laneCount*8);
+    block[0] = 1;
+    block[(state->rate-1)/8] |= 1 << ((state->rate-1) % 8);
+    for( ; outBitLen >= state->rate; outBitLen -= state->rate, out += state->rate/8) {
+        #ifdef KeccakReference
+        displayBytes(1, "Block to be absorbed (after padding)", block, state->rate/8);
+        #endif
+        DuplexAbsorb(state, block, laneCount);
+        if (((size_t)out % 8) == 0)
+            KeccakExtract(state->state, out, laneCount);
+        else {
+            KeccakExtract(state->state, buffer, laneCount);
+            memcpy(out, buffer, state->rate/8);
+        }
+    }
+    if (outBitLen > 0)
+        return Duplexing(state, NULL, 0, out, (unsigned int)outBitLen);
+    return 0;
+}
+
 int Duplexing(duplexState *state, const unsigned char *in, unsigned int inBitLen, unsigned char *out, unsigned int outBitLen)
 {
     ALIGN unsigned char block[KeccakPermutationSizeInBytes];
@@ -55,7 +105,7 @@ int Duplexing(duplexState *state, const unsigned char *in, unsigned int inBitLen
     #ifdef KeccakReference
     displayBytes(1, "Block to be absorbed (after padding)", block, (state->rate+7)/8);
     #endif
-    KeccakAbsorb(state->state, block, (state->rate+63)/64);
+    DuplexAbsorb(state, block, (state->rate+63)/64);
 
     KeccakExtract(state->state, block, (state->rate+63)/64);
     memcpy(out, block, (outBitLen+7)/8);
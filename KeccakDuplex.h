@@ -30,6 +30,7 @@ ALIGN typedef struct duplexStateStruct {
     unsigned int rate;
     unsigned int capacity;
     unsigned int rho_max;
+    unsigned int rounds;
 } duplexState;
 
 /**
@@ -41,6 +42,17 @@ ALIGN typedef struct duplexStateStruct {
   * @return Zero if successful, 1 otherwise.
   */
 int InitDuplex(duplexState *state, unsigned int rate, unsigned int capacity);
+/**
+  * Function to initialize a duplex object Duplex[Keccak-p[r+c, nr], pad10*1, r] on a
+  * reduced-round permutation, the last nr rounds of Keccak-f.
+  * @param  state       Pointer to the state of the duplex object to be initialized.
+  * @param  rate        The value of the rate r.
+  * @param  capacity    The value of the capacity c.
+  * @param  rounds      The number of rounds nr, 12 or 24 (the latter is InitDuplex()).
+  * @pre    One must have r+c=1600 in this implementation. (The value of the rate is unrestricted.)
+  * @return Zero if successful, 1 otherwise.
+  */
+int InitDuplexRounds(duplexState *state, unsigned int rate, unsigned int capacity, unsigned int rounds);
 /**
   * Function to make a duplexing call to the duplex object intialized with InitDuplex().
   * @param  state       Pointer to the state of the duplex object initialized by InitDuplex().
@@ -55,5 +67,16 @@ int InitDuplex(duplexState *state, unsigned int rate, unsigned int capacity);
   * @return Zero if successful, 1 otherwise.
   */
 int Duplexing(duplexState *state, const unsigned char *in, unsigned int inBitLen, unsigned char *out, unsigned int outBitLen);
+/**
+  * Function to make successive duplexing calls with empty input, squeezing an arbitrary number of output bits.
+  * Equivalent to calling Duplexing(state, NULL, 0, out+i*r/8, min(r, outBitLen-i*r)) for i = 0, 1, ...
+  * Whole blocks are extracted directly into the output buffer.
+  * @param  state       Pointer to the state of the duplex object initialized by InitDuplex().
+  * @param  out         Pointer to the buffer where to store the output data.
+  * @param  outBitLen   The number of output bits desired.
+  * @pre    outBitLen must be a multiple of 8, except for the last r bits.
+  * @return Zero if successful, 1 otherwise.
+  */
+int DuplexingSqueeze(duplexState *state, unsigned char *out, unsigned long long outBitLen);
 
 #endif
@@ -16,6 +16,9 @@ http://creativecommons.org/publicdomain/zero/1.0/
 
 #include "KeccakF-1600-int-set.h"
 
+const char *KeccakImplementation( void );
+// Kept for compatibility, backends need no global initialization:
+// constant tables are static, the rest is built on first state init.
 void KeccakInitialize( void );
 void KeccakInitializeState(unsigned char *state);
 void KeccakPermutation(unsigned char *state);
@@ -38,9 +41,14 @@ void KeccakAbsorb1152bits(unsigned char *state, const unsigned char *data);
 void KeccakAbsorb1344bits(unsigned char *state, const unsigned char *data);
 #endif
 void KeccakAbsorb(unsigned char *state, const unsigned char *data, unsigned int laneCount);
+// As KeccakAbsorb(), but followed by Keccak-p[1600, nr], i.e. the last nr
+// rounds of Keccak-f[1600].  nr is 12 or 24.
+void KeccakAbsorbRounds(unsigned char *state, const unsigned char *data, unsigned int laneCount, unsigned int nr);
 #ifdef ProvideFast1024
 void KeccakExtract1024bits(const unsigned char *state, unsigned char *data);
 #endif
 void KeccakExtract(const unsigned char *state, unsigned char *data, unsigned int laneCount);
+// Permutation followed by KeccakExtract(), data must be 8-byte aligned
+void KeccakPermutationAndExtract(unsigned char *state, unsigned char *data, unsigned int laneCount);
 
 #endif
@@ -22,26 +22,26 @@ typedef unsigned int UINT32;
 typedef unsigned long long int UINT64;
 
 #ifdef UseInterleaveTables
-int interleaveTablesBuilt = 0;
+#include <pthread.h>
+
+// Built once, by whichever thread initializes a state first.
+static pthread_once_t interleaveTablesOnce = PTHREAD_ONCE_INIT;
 UINT16 interleaveTable[65536];
 UINT16 deinterleaveTable[65536];
 
-void buildInterleaveTables()
+static void buildInterleaveTables()
 {
     UINT32 i, j;
     UINT16 x;
 
-    if (!interleaveTablesBuilt) {
-        for(i=0; i<65536; i++) {
-            x = 0;
-            for(j=0; j<16; j++) {
-                if (i & (1 << j))
-                    x |= (1 << (j/2 + 8*(j%2)));
-            }
-            interleaveTable[i] = x;
-            deinterleaveTable[x] = (UINT16)i;
+    for(i=0; i<65536; i++) {
+        x = 0;
+        for(j=0; j<16; j++) {
+            if (i & (1 << j))
+                x |= (1 << (j/2 + 8*(j%2)));
         }
-        interleaveTablesBuilt = 1;
+        interleaveTable[i] = x;
+        deinterleaveTable[x] = (UINT16)i;
     }
 }
 
@@ -251,6 +251,12 @@ void KeccakPermutationOnWordsAfterXoring(UINT32 *state, const UINT8 *input, unsi
     rounds
 }
 
+void KeccakPermutationOnWordsAfterXoringRounds(UINT32 *state, const UINT8 *input, unsigned int laneCount, unsigned int nr)
+{
+    xorLanesIntoState(laneCount, state, input)
+    roundsFrom(24-nr)
+}
+
 #ifdef ProvideFast576
 void KeccakPermutationOnWordsAfterXoring576bits(UINT32 *state, const UINT8 *input)
 {
@@ -322,6 +328,16 @@ void KeccakPermutationOnWordsAfterXoring(UINT32 *state, const UINT8 *input, unsi
     rounds
 }
 
+void KeccakPermutationOnWordsAfterXoringRounds(UINT32 *state, const UINT8 *input, unsigned int laneCount, unsigned int nr)
+{
+    declareABCDE
+    unsigned int i;
+
+    xorLanesIntoState(laneCount, state, input)
+    copyFromState(A, state)
+    roundsFrom(24-nr)
+}
+
 #ifdef ProvideFast576
 void KeccakPermutationOnWordsAfterXoring576bits(UINT32 *state, const UINT8 *input)
 {
@@ -396,15 +412,23 @@ void KeccakPermutationOnWordsAfterXoring1344bits(UINT32 *state, const UINT8 *inp
 
 #endif
 
+const char *KeccakImplementation()
+{
+    return "opt-32";
+}
+
 void KeccakInitialize()
 {
 #ifdef UseInterleaveTables
-    buildInterleaveTables();
+    pthread_once(&interleaveTablesOnce, buildInterleaveTables);
 #endif
 }
 
 void KeccakInitializeState(unsigned char *state)
 {
+#ifdef UseInterleaveTables
+    KeccakInitialize();
+#endif
     memset(state, 0, 200);
 #ifdef UseBebigokimisa
     ((UINT32*)state)[ 2] = ~(UINT32)0;
@@ -475,6 +499,11 @@ void KeccakAbsorb(unsigned char *state, const unsigned char *data, unsigned int
     KeccakPermutationOnWordsAfterXoring((UINT32*)state, data, laneCount);
 }
 
+void KeccakAbsorbRounds(unsigned char *state, const unsigned char *data, unsigned int laneCount, unsigned int nr)
+{
+    KeccakPermutationOnWordsAfterXoringRounds((UINT32*)state, data, laneCount, nr);
+}
+
 #ifdef ProvideFast1024
 void KeccakExtract1024bits(const unsigned char *state, unsigned char *data)
 {
@@ -522,3 +551,9 @@ void KeccakExtract(const unsigned char *state, unsigned char *data, unsigned int
     }
 #endif
 }
+
+void KeccakPermutationAndExtract(unsigned char *state, unsigned char *data, unsigned int laneCount)
+{
+    KeccakPermutationOnWords((UINT32*)state);
+    KeccakExtract(state, data, laneCount);
+}
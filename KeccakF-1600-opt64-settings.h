@@ -1,5 +1,11 @@
+// Defaults, may be overridden from the command line, e.g.
+// -DUnrolling=6 -DNoBebigokimisa as in the keccak-bench variants
+#ifndef Unrolling
 #define Unrolling 24
+#endif
+#ifndef NoBebigokimisa
 #define UseBebigokimisa
+#endif
 //#define UseSSE
 //#define UseOnlySIMD64
 //#define UseMMX
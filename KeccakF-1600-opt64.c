@@ -205,6 +205,20 @@ void KeccakPermutationOnWordsAfterXoring(UINT64 *state, const UINT64 *input, uns
 #endif
 }
 
+void KeccakPermutationOnWordsAfterXoringRounds(UINT64 *state, const UINT64 *input, unsigned int laneCount, unsigned int nr)
+{
+    declareABCDE
+    unsigned int i, j;
+
+    for(j=0; j<laneCount; j++)
+        state[j] ^= input[j];
+    copyFromState(A, state)
+    roundsFrom(24-nr)
+#if defined(UseMMX)
+    _mm_empty();
+#endif
+}
+
 #ifdef ProvideFast576
 void KeccakPermutationOnWordsAfterXoring576bits(UINT64 *state, const UINT64 *input)
 {
@@ -301,6 +315,11 @@ void KeccakPermutationOnWordsAfterXoring1344bits(UINT64 *state, const UINT64 *in
 }
 #endif
 
+const char *KeccakImplementation()
+{
+    return "opt-64";
+}
+
 void KeccakInitialize()
 {
 }
@@ -443,6 +462,20 @@ void KeccakAbsorb(unsigned char *state, const unsigned char *data, unsigned int
 #endif
 }
 
+void KeccakAbsorbRounds(unsigned char *state, const unsigned char *data, unsigned int laneCount, unsigned int nr)
+{
+#if (PLATFORM_BYTE_ORDER == IS_LITTLE_ENDIAN)
+    KeccakPermutationOnWordsAfterXoringRounds((UINT64*)state, (const UINT64*)data, laneCount, nr);
+#else
+    UINT64 dataAsWords[25];
+    unsigned int i;
+
+    for(i=0; i<laneCount; i++)
+        fromBytesToWord(dataAsWords+i, data+(i*8));
+    KeccakPermutationOnWordsAfterXoringRounds((UINT64*)state, dataAsWords, laneCount, nr);
+#endif
+}
+
 void fromWordToBytes(UINT8 *bytes, const UINT64 word)
 {
     unsigned int i;
@@ -502,3 +535,9 @@ void KeccakExtract(const unsigned char *state, unsigned char *data, unsigned int
     }
 #endif
 }
+
+void KeccakPermutationAndExtract(unsigned char *state, unsigned char *data, unsigned int laneCount)
+{
+    KeccakPermutationOnWords((UINT64*)state);
+    KeccakExtract(state, data, laneCount);
+}
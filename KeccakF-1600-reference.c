@@ -22,11 +22,35 @@ typedef unsigned char UINT8;
 typedef unsigned long long int UINT64;
 
 #define nrRounds 24
-UINT64 KeccakRoundConstants[nrRounds];
+// Round constants, generated by the LFSR x^8+x^6+x^5+x^4+1:
+// bit 2^j-1 of RC[i] is output 7*i+j of the LFSR started at 0x01.
+static const UINT64 KeccakRoundConstants[nrRounds] = {
+    0x0000000000000001ULL, 0x0000000000008082ULL,
+    0x800000000000808AULL, 0x8000000080008000ULL,
+    0x000000000000808BULL, 0x0000000080000001ULL,
+    0x8000000080008081ULL, 0x8000000000008009ULL,
+    0x000000000000008AULL, 0x0000000000000088ULL,
+    0x0000000080008009ULL, 0x000000008000000AULL,
+    0x000000008000808BULL, 0x800000000000008BULL,
+    0x8000000000008089ULL, 0x8000000000008003ULL,
+    0x8000000000008002ULL, 0x8000000000000080ULL,
+    0x000000000000800AULL, 0x800000008000000AULL,
+    0x8000000080008081ULL, 0x8000000000008080ULL,
+    0x0000000080000001ULL, 0x8000000080008008ULL,
+};
 #define nrLanes 25
-unsigned int KeccakRhoOffsets[nrLanes];
+// Rho offsets indexed by x+5*y: (t+1)(t+2)/2 mod 64 for the lane reached
+// at step t from (1, 0) by (x, y) -> (y, 2x+3y), 0 for lane (0, 0).
+static const unsigned int KeccakRhoOffsets[nrLanes] = {
+     0,  1, 62, 28, 27,
+    36, 44,  6, 55, 20,
+     3, 10, 43, 25, 39,
+    41, 45, 15, 21,  8,
+    18,  2, 61, 56, 14,
+};
 
 void KeccakPermutationOnWords(UINT64 *state);
+void KeccakPermutationOnWordsRounds(UINT64 *state, unsigned int nr);
 void theta(UINT64 *A);
 void rho(UINT64 *A);
 void pi(UINT64 *A);
@@ -53,7 +77,7 @@ void fromWordsToBytes(unsigned char *state, const UINT64 *stateAsWords)
             state[i*(64/8)+j] = (stateAsWords[i] >> (8*j)) & 0xFF;
 }
 
-void KeccakPermutation(unsigned char *state)
+void KeccakPermutationRounds(unsigned char *state, unsigned int nr)
 {
 #if (PLATFORM_BYTE_ORDER != IS_LITTLE_ENDIAN)
     UINT64 stateAsWords[KeccakPermutationSize/64];
@@ -61,15 +85,20 @@ void KeccakPermutation(unsigned char *state)
 
     displayStateAsBytes(1, "Input of permutation", state);
 #if (PLATFORM_BYTE_ORDER == IS_LITTLE_ENDIAN)
-    KeccakPermutationOnWords((UINT64*)state);
+    KeccakPermutationOnWordsRounds((UINT64*)state, nr);
 #else
     fromBytesToWords(stateAsWords, state);
-    KeccakPermutationOnWords(stateAsWords);
+    KeccakPermutationOnWordsRounds(stateAsWords, nr);
     fromWordsToBytes(state, stateAsWords);
 #endif
     displayStateAsBytes(1, "State after permutation", state);
 }
 
+void KeccakPermutation(unsigned char *state)
+{
+    KeccakPermutationRounds(state, nrRounds);
+}
+
 void KeccakPermutationAfterXor(unsigned char *state, const unsigned char *data, unsigned int dataLengthInBytes)
 {
     unsigned int i;
@@ -80,12 +109,18 @@ void KeccakPermutationAfterXor(unsigned char *state, const unsigned char *data,
 }
 
 void KeccakPermutationOnWords(UINT64 *state)
+{
+    KeccakPermutationOnWordsRounds(state, nrRounds);
+}
+
+// Keccak-p[1600, nr]: rounds nrRounds-nr to nrRounds-1 of Keccak-f[1600]
+void KeccakPermutationOnWordsRounds(UINT64 *state, unsigned int nr)
 {
     unsigned int i;
 
     displayStateAs64bitWords(3, "Same, with lanes as 64-bit words", state);
 
-    for(i=0; i<nrRounds; i++) {
+    for(i=nrRounds-nr; i<nrRounds; i++) {
         displayRoundNumber(3, i);
 
         theta(state);
@@ -162,52 +197,13 @@ void iota(UINT64 *A, unsigned int indexRound)
     A[index(0, 0)] ^= KeccakRoundConstants[indexRound];
 }
 
-int LFSR86540(UINT8 *LFSR)
-{
-    int result = ((*LFSR) & 0x01) != 0;
-    if (((*LFSR) & 0x80) != 0)
-        // Primitive polynomial over GF(2): x^8+x^6+x^5+x^4+1
-        (*LFSR) = ((*LFSR) << 1) ^ 0x71;
-    else
-        (*LFSR) <<= 1;
-    return result;
-}
-
-void KeccakInitializeRoundConstants()
+const char *KeccakImplementation()
 {
-    UINT8 LFSRstate = 0x01;
-    unsigned int i, j, bitPosition;
-
-    for(i=0; i<nrRounds; i++) {
-        KeccakRoundConstants[i] = 0;
-        for(j=0; j<7; j++) {
-            bitPosition = (1<<j)-1; //2^j-1
-            if (LFSR86540(&LFSRstate))
-                KeccakRoundConstants[i] ^= (UINT64)1<<bitPosition;
-        }
-    }
-}
-
-void KeccakInitializeRhoOffsets()
-{
-    unsigned int x, y, t, newX, newY;
-
-    KeccakRhoOffsets[index(0, 0)] = 0;
-    x = 1;
-    y = 0;
-    for(t=0; t<24; t++) {
-        KeccakRhoOffsets[index(x, y)] = ((t+1)*(t+2)/2) % 64;
-        newX = (0*x+1*y) % 5;
-        newY = (2*x+3*y) % 5;
-        x = newX;
-        y = newY;
-    }
+    return "ref";
 }
 
 void KeccakInitialize()
 {
-    KeccakInitializeRoundConstants();
-    KeccakInitializeRhoOffsets();
 }
 
 void displayRoundConstants(FILE *f)
@@ -287,6 +283,15 @@ void KeccakAbsorb(unsigned char *state, const unsigned char *data, unsigned int
     KeccakPermutationAfterXor(state, data, laneCount*8);
 }
 
+void KeccakAbsorbRounds(unsigned char *state, const unsigned char *data, unsigned int laneCount, unsigned int nr)
+{
+    unsigned int i;
+
+    for(i=0; i<laneCount*8; i++)
+        state[i] ^= data[i];
+    KeccakPermutationRounds(state, nr);
+}
+
 #ifdef ProvideFast1024
 void KeccakExtract1024bits(const unsigned char *state, unsigned char *data)
 {
@@ -298,3 +303,9 @@ void KeccakExtract(const unsigned char *state, unsigned char *data, unsigned int
 {
     memcpy(data, state, laneCount*8);
 }
+
+void KeccakPermutationAndExtract(unsigned char *state, unsigned char *data, unsigned int laneCount)
+{
+    KeccakPermutation(state);
+    KeccakExtract(state, data, laneCount);
+}
@@ -19,6 +19,14 @@ http://creativecommons.org/publicdomain/zero/1.0/
 typedef unsigned char UINT8;
 typedef unsigned long long int UINT64;
 
+// Rounds 12 to 23 of Keccak-f, in KeccakF-1600-x86-64-gas.s
+void KeccakPermutation12rounds(unsigned char *state);
+
+const char *KeccakImplementation()
+{
+    return "opt-64-asm";
+}
+
 void KeccakInitialize()
 {
 }
@@ -60,3 +68,22 @@ void KeccakExtract(const unsigned char *state, unsigned char *data, unsigned int
 
 #endif
 }
+
+void KeccakAbsorbRounds(unsigned char *state, const unsigned char *data, unsigned int laneCount, unsigned int nr)
+{
+    unsigned int i;
+
+    if (nr == 24) {
+        KeccakAbsorb(state, data, laneCount);
+        return;
+    }
+    for(i=0; i<laneCount; i++)
+        ((UINT64*)state)[i] ^= ((const UINT64*)data)[i];
+    KeccakPermutation12rounds(state);
+}
+
+void KeccakPermutationAndExtract(unsigned char *state, unsigned char *data, unsigned int laneCount)
+{
+    KeccakPermutation(state);
+    KeccakExtract(state, data, laneCount);
+}
@@ -354,7 +354,8 @@
 
 		.endm
 
-.macro	mKeccakPermutation	
+#	firstRound 12 leaves out the first half, i.e. Keccak-p[1600, 12]
+.macro	mKeccakPermutation	firstRound=0
 
 		subq		$8*25, %rsp
 
@@ -381,6 +382,7 @@
 		xorq		_su(rpState), rCu             
 
 
+		.if		\firstRound == 0
 		mKeccakRound	rpState, rpStack, 0x0000000000000001, 0
 		mKeccakRound	rpStack, rpState, 0x0000000000008082, 0
 		mKeccakRound	rpState, rpStack, 0x800000000000808a, 0
@@ -394,6 +396,7 @@
 		mKeccakRound	rpStack, rpState, 0x0000000000000088, 0
 		mKeccakRound	rpState, rpStack, 0x0000000080008009, 0
 		mKeccakRound	rpStack, rpState, 0x000000008000000a, 0
+		.endif
 
 		mKeccakRound	rpState, rpStack, 0x000000008000808b, 0
 		mKeccakRound	rpStack, rpState, 0x800000000000008b, 0
@@ -495,6 +498,7 @@
 	.size	KeccakPermutation, .-KeccakPermutation
 	.align	2
 	.global	KeccakPermutation
+	.hidden	KeccakPermutation
 	.type	KeccakPermutation, %function
 KeccakPermutation:
 
@@ -503,11 +507,26 @@ KeccakPermutation:
 	mPopRegs
 	ret
 
+# -------------------------------------------------------------------------
+
+	.size	KeccakPermutation12rounds, .-KeccakPermutation12rounds
+	.align	2
+	.global	KeccakPermutation12rounds
+	.hidden	KeccakPermutation12rounds
+	.type	KeccakPermutation12rounds, %function
+KeccakPermutation12rounds:
+
+	mPushRegs
+	mKeccakPermutation	12
+	mPopRegs
+	ret
+
 # -------------------------------------------------------------------------
 
 	.size	KeccakAbsorb576bits, .-KeccakAbsorb576bits
 	.align	2
 	.global	KeccakAbsorb576bits
+	.hidden	KeccakAbsorb576bits
 	.type	KeccakAbsorb576bits, %function
 KeccakAbsorb576bits:
 
@@ -524,6 +543,7 @@ KeccakAbsorb576bits:
 	.size	KeccakAbsorb832bits, .-KeccakAbsorb832bits
 	.align	2
 	.global	KeccakAbsorb832bits
+	.hidden	KeccakAbsorb832bits
 	.type	KeccakAbsorb832bits, %function
 KeccakAbsorb832bits:
 
@@ -541,6 +561,7 @@ KeccakAbsorb832bits:
 	.size	KeccakAbsorb1024bits, .-KeccakAbsorb1024bits
 	.align	2
 	.global	KeccakAbsorb1024bits
+	.hidden	KeccakAbsorb1024bits
 	.type	KeccakAbsorb1024bits, %function
 KeccakAbsorb1024bits:
 
@@ -556,6 +577,7 @@ KeccakAbsorb1024bits:
 	.size	KeccakAbsorb1088bits, .-KeccakAbsorb1088bits
 	.align	2
 	.global	KeccakAbsorb1088bits
+	.hidden	KeccakAbsorb1088bits
 	.type	KeccakAbsorb1088bits, %function
 KeccakAbsorb1088bits:
 
@@ -573,6 +595,7 @@ KeccakAbsorb1088bits:
 	.size	KeccakAbsorb1152bits, .-KeccakAbsorb1152bits
 	.align	2
 	.global	KeccakAbsorb1152bits
+	.hidden	KeccakAbsorb1152bits
 	.type	KeccakAbsorb1152bits, %function
 KeccakAbsorb1152bits:
 
@@ -589,6 +612,7 @@ KeccakAbsorb1152bits:
 	.size	KeccakAbsorb1344bits, .-KeccakAbsorb1344bits
 	.align	2
 	.global	KeccakAbsorb1344bits
+	.hidden	KeccakAbsorb1344bits
 	.type	KeccakAbsorb1344bits, %function
 KeccakAbsorb1344bits:
 
@@ -607,6 +631,7 @@ KeccakAbsorb1344bits:
 	.size	KeccakAbsorb, .-KeccakAbsorb
 	.align	2
 	.global	KeccakAbsorb
+	.hidden	KeccakAbsorb
 	.type	KeccakAbsorb, %function
 KeccakAbsorb:
 
@@ -658,6 +683,7 @@ xorInputToStateDone:
 	.size	KeccakInitializeState, .-KeccakInitializeState
 	.align	2
 	.global	KeccakInitializeState
+	.hidden	KeccakInitializeState
 	.type	KeccakInitializeState, %function
 KeccakInitializeState:
 	xorq		%rax, %rax
@@ -720,6 +746,7 @@ KeccakInitializeState:
 	.size	KeccakExtract1024bits, .-KeccakExtract1024bits
 	.align	2
 	.global	KeccakExtract1024bits
+	.hidden	KeccakExtract1024bits
 	.type	KeccakExtract1024bits, %function
 KeccakExtract1024bits:
 
@@ -764,3 +791,4 @@ KeccakExtract1024bits:
 	movq		%r8,  15*8(%rsi)
 	ret
 
+	.section	.note.GNU-stack,"",@progbits
@@ -0,0 +1,298 @@
+/*
+The Keccak sponge function, designed by Guido Bertoni, Joan Daemen,
+Michaël Peeters and Gilles Van Assche. For more information, feedback or
+questions, please refer to our website: http://keccak.noekeon.org/
+
+Implementation by the designers,
+hereby denoted as "the implementer".
+
+To the extent possible under law, the implementer has waived all copyright
+and related or neighboring rights to the source code in this file.
+http://creativecommons.org/publicdomain/zero/1.0/
+*/
+
+#include <string.h>
+#include "KeccakNISTInterface.h"
+#include "KeccakF-1600-interface.h"
+
+HashReturn Init(hashState *state, int hashbitlen)
+{
+    switch(hashbitlen) {
+        case 0: // Default parameters, arbitrary length output
+            InitSponge((spongeState*)state, 1024, 576);
+            break;
+        case 224:
+            InitSponge((spongeState*)state, 1152, 448);
+            break;
+        case 256:
+            InitSponge((spongeState*)state, 1088, 512);
+            break;
+        case 384:
+            InitSponge((spongeState*)state, 832, 768);
+            break;
+        case 512:
+            InitSponge((spongeState*)state, 576, 1024);
+            break;
+        default:
+            return BAD_HASHLEN;
+    }
+    state->fixedOutputLength = hashbitlen;
+    return SUCCESS;
+}
+
+HashReturn Update(hashState *state, const BitSequence *data, DataLength databitlen)
+{
+    if ((databitlen % 8) == 0)
+        return Absorb((spongeState*)state, data, databitlen);
+    else {
+        HashReturn ret = Absorb((spongeState*)state, data, databitlen - (databitlen % 8));
+        if (ret == SUCCESS) {
+            unsigned char lastByte;
+            // Align the last partial byte to the least significant bits
+            lastByte = data[databitlen/8] >> (8 - (databitlen % 8));
+            return Absorb((spongeState*)state, &lastByte, databitlen % 8);
+        }
+        else
+            return ret;
+    }
+}
+
+HashReturn Final(hashState *state, BitSequence *hashval)
+{
+    return Squeeze(state, hashval, state->fixedOutputLength);
+}
+
+HashReturn Hash(int hashbitlen, const BitSequence *data, DataLength databitlen, BitSequence *hashval)
+{
+    hashState state;
+    HashReturn result;
+
+    if ((hashbitlen != 224) && (hashbitlen != 256) && (hashbitlen != 384) && (hashbitlen != 512))
+        return BAD_HASHLEN; // Only the four fixed output lengths available through this API
+    result = Init(&state, hashbitlen);
+    if (result != SUCCESS)
+        return result;
+    result = Update(&state, data, databitlen);
+    if (result != SUCCESS)
+        return result;
+    result = Final(&state, hashval);
+    return result;
+}
+
+#if defined(__GNUC__)
+
+// Multi-buffer hashing: HashManyWays independent Keccak-f[1600] states
+// are kept lane by lane in vectors, so that every operation of the
+// permutation processes all messages at once.  With -mavx2 or -mavx512f
+// the vectors map to single registers.
+
+typedef unsigned long long int UINT64;
+
+#if defined(__AVX512F__)
+#define HashManyWays 8
+#else
+#define HashManyWays 4
+#endif
+
+typedef UINT64 V64 __attribute__((vector_size(8*HashManyWays)));
+
+#define ROL64V(a, offset) (((a) << (offset)) ^ ((a) >> (64-(offset))))
+
+static const UINT64 HashManyRoundConstants[24] = {
+    0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808aULL,
+    0x8000000080008000ULL, 0x000000000000808bULL, 0x0000000080000001ULL,
+    0x8000000080008081ULL, 0x8000000000008009ULL, 0x000000000000008aULL,
+    0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000aULL,
+    0x000000008000808bULL, 0x800000000000008bULL, 0x8000000000008089ULL,
+    0x8000000000008003ULL, 0x8000000000008002ULL, 0x8000000000000080ULL,
+    0x000000000000800aULL, 0x800000008000000aULL, 0x8000000080008081ULL,
+    0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL,
+};
+
+// Rho offsets of lane x+5y
+static const unsigned int HashManyRhoOffsets[25] = {
+     0,  1, 62, 28, 27,
+    36, 44,  6, 55, 20,
+     3, 10, 43, 25, 39,
+    41, 45, 15, 21,  8,
+    18,  2, 61, 56, 14,
+};
+
+static void KeccakPermutationMany(V64 *A)
+{
+    V64 B[25], C[5], D, rc;
+    unsigned int round, x, y, i;
+
+    for(round=0; round<24; round++) {
+        // Theta
+        for(x=0; x<5; x++)
+            C[x] = A[x] ^ A[x+5] ^ A[x+10] ^ A[x+15] ^ A[x+20];
+        for(x=0; x<5; x++) {
+            D = C[(x+4)%5] ^ ROL64V(C[(x+1)%5], 1);
+            for(y=0; y<25; y+=5)
+                A[y+x] ^= D;
+        }
+        // Rho and pi, lane (x, y) moves to (y, 2x+3y)
+        B[0] = A[0];
+        for(x=0; x<5; x++)
+            for(y=0; y<5; y++)
+                if ((x+5*y) != 0)
+                    B[y+5*((2*x+3*y)%5)] = ROL64V(A[x+5*y], HashManyRhoOffsets[x+5*y]);
+        // Chi
+        for(y=0; y<25; y+=5)
+            for(x=0; x<5; x++)
+                A[y+x] = B[y+x] ^ (~B[y+(x+1)%5] & B[y+(x+2)%5]);
+        // Iota
+        for(i=0; i<HashManyWays; i++)
+            rc[i] = HashManyRoundConstants[round];
+        A[0] ^= rc;
+    }
+}
+
+static UINT64 HashManyLoadLane(const unsigned char *bytes)
+{
+    UINT64 lane = 0;
+    unsigned int i;
+
+    for(i=0; i<8; i++)
+        lane |= (UINT64)bytes[i] << (8*i);
+    return lane;
+}
+
+// Build block number blockIndex of the message followed by the suffix bits
+// and padded with pad10*1.  The last partial byte is taken from its most
+// significant bits, as in Update().
+static void HashManyBlock(unsigned char *block, unsigned int rateInBytes,
+    const BitSequence *data, DataLength databitlen, unsigned char suffix, unsigned int suffixbitlen,
+    DataLength blockIndex, int lastBlock)
+{
+    DataLength offset = blockIndex*rateInBytes;
+    DataLength wholeBytes = databitlen/8;
+    unsigned int partialBits = (unsigned int)(databitlen % 8);
+    unsigned int tail, k;
+
+    memset(block, 0, rateInBytes);
+    if (offset < wholeBytes)
+        memcpy(block, data+offset, (wholeBytes-offset < rateInBytes) ? (size_t)(wholeBytes-offset) : rateInBytes);
+    // Partial byte, suffix and first padding bit span at most two bytes
+    tail = (partialBits != 0) ? data[wholeBytes] >> (8 - partialBits) : 0;
+    tail |= (unsigned int)suffix << partialBits;
+    tail |= 1U << (partialBits + suffixbitlen);
+    for(k=0; k<2; k++)
+        if ((wholeBytes+k >= offset) && (wholeBytes+k < offset+rateInBytes))
+            block[wholeBytes+k-offset] |= (unsigned char)(tail >> (8*k));
+    if (lastBlock)
+        block[rateInBytes-1] |= 0x80;
+}
+
+static HashReturn KeccakMany(int hashbitlen, const BitSequence *data[], const DataLength databitlen[],
+    unsigned char suffix, unsigned int suffixbitlen, BitSequence *hashval[], unsigned int n)
+{
+    V64 A[25];
+    ALIGN unsigned char block[KeccakMaximumRateInBytes];
+    DataLength blockIndex[HashManyWays], blockCount[HashManyWays];
+    unsigned int message[HashManyWays];
+    unsigned int rate, rateInBytes, next, active, i, j;
+    UINT64 lane;
+
+    switch(hashbitlen) {
+        case 224: rate = 1152; break;
+        case 256: rate = 1088; break;
+        case 384: rate = 832; break;
+        case 512: rate = 576; break;
+        default:
+            return BAD_HASHLEN;
+    }
+    rateInBytes = rate/8;
+
+    // Every way runs its own message, a way whose message is done takes
+    // the next one, so that ragged lengths don't leave ways idle.
+    memset(A, 0, sizeof(A));
+    next = 0;
+    active = 0;
+    for(i=0; i<HashManyWays; i++) {
+        message[i] = n;
+        if (next < n) {
+            message[i] = next++;
+            blockIndex[i] = 0;
+            blockCount[i] = (databitlen[message[i]] + suffixbitlen + 2 + rate - 1)/rate;
+            active++;
+        }
+    }
+    while(active > 0) {
+        for(i=0; i<HashManyWays; i++) {
+            if (message[i] == n)
+                continue; // Finished way absorbs nothing, its output is discarded
+            HashManyBlock(block, rateInBytes, data[message[i]], databitlen[message[i]],
+                suffix, suffixbitlen, blockIndex[i], blockIndex[i]+1 == blockCount[i]);
+            for(j=0; j<rateInBytes/8; j++)
+                A[j][i] ^= HashManyLoadLane(block+8*j);
+        }
+        KeccakPermutationMany(A);
+        for(i=0; i<HashManyWays; i++) {
+            if ((message[i] == n) || (++blockIndex[i] < blockCount[i]))
+                continue;
+            for(j=0; j<(unsigned int)hashbitlen/8; j++) {
+                lane = A[j/8][i];
+                hashval[message[i]][j] = (unsigned char)(lane >> (8*(j%8)));
+            }
+            for(j=0; j<25; j++)
+                A[j][i] = 0;
+            if (next < n) {
+                message[i] = next++;
+                blockIndex[i] = 0;
+                blockCount[i] = (databitlen[message[i]] + suffixbitlen + 2 + rate - 1)/rate;
+            }
+            else {
+                message[i] = n;
+                active--;
+            }
+        }
+    }
+    return SUCCESS;
+}
+
+#else
+
+static HashReturn KeccakMany(int hashbitlen, const BitSequence *data[], const DataLength databitlen[],
+    unsigned char suffix, unsigned int suffixbitlen, BitSequence *hashval[], unsigned int n)
+{
+    hashState state;
+    HashReturn result;
+    unsigned int i;
+
+    if ((hashbitlen != 224) && (hashbitlen != 256) && (hashbitlen != 384) && (hashbitlen != 512))
+        return BAD_HASHLEN;
+    for(i=0; i<n; i++) {
+        result = Init(&state, hashbitlen);
+        if (result == SUCCESS)
+            result = Update(&state, data[i], databitlen[i]);
+        if ((result == SUCCESS) && (suffixbitlen > 0))
+            result = Absorb(&state, &suffix, suffixbitlen);
+        if (result == SUCCESS)
+            result = Final(&state, hashval[i]);
+        if (result != SUCCESS)
+            return result;
+    }
+    return SUCCESS;
+}
+
+#endif
+
+HashReturn HashMany(int hashbitlen, const BitSequence *data[], const DataLength databitlen[], BitSequence *hashval[], unsigned int n)
+{
+    return KeccakMany(hashbitlen, data, databitlen, 0, 0, hashval, n);
+}
+
+HashReturn HashManySuffix(int hashbitlen, const BitSequence *data[], const DataLength databitlen[],
+    unsigned char suffix, unsigned int suffixbitlen, BitSequence *hashval[], unsigned int n)
+{
+    unsigned int i;
+
+    if (suffixbitlen > 7)
+        return FAIL;
+    for(i=0; i<n; i++)
+        if ((databitlen[i] % 8) != 0)
+            return FAIL;
+    return KeccakMany(hashbitlen, data, databitlen, suffix & ((1 << suffixbitlen) - 1), suffixbitlen, hashval, n);
+}
@@ -66,5 +66,28 @@ HashReturn Final(hashState *state, BitSequence *hashval);
   * @return SUCCESS if successful, BAD_HASHLEN if the value of hashbitlen is incorrect.
   */
 HashReturn Hash(int hashbitlen, const BitSequence *data, DataLength databitlen, BitSequence *hashval);
+/**
+  * Function to hash many independent messages, equivalent to calling Hash() on each.
+  * Messages are processed in parallel in SIMD lanes where the compiler supports it,
+  * which is faster than looping on Hash() for batches of short messages.
+  * @param  hashbitlen  The desired number of output bits.
+  * @param  data        Array of @a n pointers to the input data.
+  * @param  databitlen  Array of @a n input lengths in bits, as in Hash().
+  * @param  hashval     Array of @a n pointers to the buffers where to store the output data.
+  * @param  n           The number of messages.
+  * @pre    The value of hashbitlen must be one of 224, 256, 384 and 512.
+  * @return SUCCESS if successful, BAD_HASHLEN if the value of hashbitlen is incorrect.
+  */
+HashReturn HashMany(int hashbitlen, const BitSequence *data[], const DataLength databitlen[], BitSequence *hashval[], unsigned int n);
+/**
+  * Function like HashMany(), with @a suffixbitlen bits of @a suffix appended to every message
+  * before padding, as used for domain separation in tree hashing.
+  * @param  suffix       The suffix bits, the first one in the least significant bit.
+  * @param  suffixbitlen The number of suffix bits, at most 7.
+  * @pre    Every value of databitlen must be a multiple of 8.
+  * @return SUCCESS if successful, BAD_HASHLEN if the value of hashbitlen is incorrect, FAIL otherwise.
+  */
+HashReturn HashManySuffix(int hashbitlen, const BitSequence *data[], const DataLength databitlen[],
+    unsigned char suffix, unsigned int suffixbitlen, BitSequence *hashval[], unsigned int n);
 
 #endif
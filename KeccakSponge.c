@@ -18,13 +18,92 @@ http://creativecommons.org/publicdomain/zero/1.0/
 #include "displayIntermediateValues.h"
 #endif
 
+#ifdef ProvideFast576
+static void KeccakAbsorb576(unsigned char *state, const unsigned char *data, unsigned int laneCount)
+{
+    KeccakAbsorb576bits(state, data);
+}
+#endif
+#ifdef ProvideFast832
+static void KeccakAbsorb832(unsigned char *state, const unsigned char *data, unsigned int laneCount)
+{
+    KeccakAbsorb832bits(state, data);
+}
+#endif
+#ifdef ProvideFast1024
+static void KeccakAbsorb1024(unsigned char *state, const unsigned char *data, unsigned int laneCount)
+{
+    KeccakAbsorb1024bits(state, data);
+}
+
+static void KeccakExtract1024(const unsigned char *state, unsigned char *data, unsigned int laneCount)
+{
+    KeccakExtract1024bits(state, data);
+}
+#endif
+#ifdef ProvideFast1088
+static void KeccakAbsorb1088(unsigned char *state, const unsigned char *data, unsigned int laneCount)
+{
+    KeccakAbsorb1088bits(state, data);
+}
+#endif
+#ifdef ProvideFast1152
+static void KeccakAbsorb1152(unsigned char *state, const unsigned char *data, unsigned int laneCount)
+{
+    KeccakAbsorb1152bits(state, data);
+}
+#endif
+#ifdef ProvideFast1344
+static void KeccakAbsorb1344(unsigned char *state, const unsigned char *data, unsigned int laneCount)
+{
+    KeccakAbsorb1344bits(state, data);
+}
+#endif
+
+static KeccakAbsorbFunction SelectAbsorb(unsigned int rate)
+{
+#ifdef ProvideFast576
+    if (rate == 576)
+        return KeccakAbsorb576;
+#endif
+#ifdef ProvideFast832
+    if (rate == 832)
+        return KeccakAbsorb832;
+#endif
+#ifdef ProvideFast1024
+    if (rate == 1024)
+        return KeccakAbsorb1024;
+#endif
+#ifdef ProvideFast1088
+    if (rate == 1088)
+        return KeccakAbsorb1088;
+#endif
+#ifdef ProvideFast1152
+    if (rate == 1152)
+        return KeccakAbsorb1152;
+#endif
+#ifdef ProvideFast1344
+    if (rate == 1344)
+        return KeccakAbsorb1344;
+#endif
+    return KeccakAbsorb;
+}
+
+static KeccakExtractFunction SelectExtract(unsigned int rate)
+{
+#ifdef ProvideFast1024
+    if (rate == 1024)
+        return KeccakExtract1024;
+#endif
+    return KeccakExtract;
+}
+
 int InitSponge(spongeState *state, unsigned int rate, unsigned int capacity)
 {
     if (rate+capacity != 1600)
         return 1;
     if ((rate <= 0) || (rate >= 1600) || ((rate % 64) != 0))
         return 1;
-    KeccakInitialize();
     state->rate = rate;
     state->capacity = capacity;
     state->fixedOutputLength = 0;
@@ -33,6 +112,9 @@ int InitSponge(spongeState *state, unsigned int rate, unsigned int capacity)
     state->bitsInQueue = 0;
     state->squeezing = 0;
     state->bitsAvailableForSqueezing = 0;
+    // Rate is fixed from now on, select block routines once
+    state->absorb = SelectAbsorb(rate);
+    state->extract = SelectExtract(rate);
 
     return 0;
 }
@@ -43,37 +125,7 @@ void AbsorbQueue(spongeState *state)
     #ifdef KeccakReference
     displayBytes(1, "Block to be absorbed", state->dataQueue, state->rate/8);
     #endif
-#ifdef ProvideFast576
-    if (state->rate == 576)
-        KeccakAbsorb576bits(state->state, state->dataQueue);
-    else 
-#endif
-#ifdef ProvideFast832
-    if (state->rate == 832)
-        KeccakAbsorb832bits(state->state, state->dataQueue);
-    else 
-#endif
-#ifdef ProvideFast1024
-    if (state->rate == 1024)
-        KeccakAbsorb1024bits(state->state, state->dataQueue);
-    else 
-#endif
-#ifdef ProvideFast1088
-    if (state->rate == 1088)
-        KeccakAbsorb1088bits(state->state, state->dataQueue);
-    else
-#endif
-#ifdef ProvideFast1152
-    if (state->rate == 1152)
-        KeccakAbsorb1152bits(state->state, state->dataQueue);
-    else 
-#endif
-#ifdef ProvideFast1344
-    if (state->rate == 1344)
-        KeccakAbsorb1344bits(state->state, state->dataQueue);
-    else 
-#endif
-        KeccakAbsorb(state->state, state->dataQueue, state->rate/64);
+    state->absorb(state->state, state->dataQueue, state->rate/64);
     state->bitsInQueue = 0;
 }
 
@@ -82,6 +134,9 @@ int Absorb(spongeState *state, const unsigned char *data, unsigned long long dat
     unsigned long long i, j, wholeBlocks;
     unsigned int partialBlock, partialByte;
     const unsigned char *curData;
+    KeccakAbsorbFunction absorb = state->absorb;
+    unsigned int laneCount = state->rate/64;
+    unsigned int rateInBytes = state->rate/8;
 
     if ((state->bitsInQueue % 8) != 0)
         return 1; // Only the last call may contain a partial byte
@@ -93,79 +148,11 @@ int Absorb(spongeState *state, const unsigned char *data, unsigned long long dat
         if ((state->bitsInQueue == 0) && (databitlen >= state->rate) && (i <= (databitlen-state->rate))) {
             wholeBlocks = (databitlen-i)/state->rate;
             curData = data+i/8;
-#ifdef ProvideFast576
-            if (state->rate == 576) {
-                for(j=0; j<wholeBlocks; j++, curData+=576/8) {
-                    #ifdef KeccakReference
-                    displayBytes(1, "Block to be absorbed", curData, state->rate/8);
-                    #endif
-                    KeccakAbsorb576bits(state->state, curData);
-                }
-            }
-            else
-#endif
-#ifdef ProvideFast832
-            if (state->rate == 832) {
-                for(j=0; j<wholeBlocks; j++, curData+=832/8) {
-                    #ifdef KeccakReference
-                    displayBytes(1, "Block to be absorbed", curData, state->rate/8);
-                    #endif
-                    KeccakAbsorb832bits(state->state, curData);
-                }
-            }
-            else
-#endif
-#ifdef ProvideFast1024
-            if (state->rate == 1024) {
-                for(j=0; j<wholeBlocks; j++, curData+=1024/8) {
-                    #ifdef KeccakReference
-                    displayBytes(1, "Block to be absorbed", curData, state->rate/8);
-                    #endif
-                    KeccakAbsorb1024bits(state->state, curData);
-                }
-            }
-            else
-#endif
-#ifdef ProvideFast1088
-            if (state->rate == 1088) {
-                for(j=0; j<wholeBlocks; j++, curData+=1088/8) {
-                    #ifdef KeccakReference
-                    displayBytes(1, "Block to be absorbed", curData, state->rate/8);
-                    #endif
-                    KeccakAbsorb1088bits(state->state, curData);
-                }
-            }
-            else
-#endif
-#ifdef ProvideFast1152
-            if (state->rate == 1152) {
-                for(j=0; j<wholeBlocks; j++, curData+=1152/8) {
-                    #ifdef KeccakReference
-                    displayBytes(1, "Block to be absorbed", curData, state->rate/8);
-                    #endif
-                    KeccakAbsorb1152bits(state->state, curData);
-                }
-            }
-            else
-#endif
-#ifdef ProvideFast1344
-            if (state->rate == 1344) {
-                for(j=0; j<wholeBlocks; j++, curData+=1344/8) {
-                    #ifdef KeccakReference
-                    displayBytes(1, "Block to be absorbed", curData, state->rate/8);
-                    #endif
-                    KeccakAbsorb1344bits(state->state, curData);
-                }
-            }
-            else
-#endif
-            {
-                for(j=0; j<wholeBlocks; j++, curData+=state->rate/8) {
-                    #ifdef KeccakReference
-                    displayBytes(1, "Block to be absorbed", curData, state->rate/8);
-                    #endif
-                    KeccakAbsorb(state->state, curData, state->rate/64);
-                }
+            for(j=0; j<wholeBlocks; j++, curData+=rateInBytes) {
+                #ifdef KeccakReference
+                displayBytes(1, "Block to be absorbed", curData, rateInBytes);
+                #endif
+                absorb(state->state, curData, laneCount);
             }
             i += wholeBlocks*state->rate;
         }
@@ -209,17 +196,8 @@ void PadAndSwitchToSqueezingPhase(spongeState *state)
     #ifdef KeccakReference
     displayText(1, "--- Switching to squeezing phase ---");
     #endif
-#ifdef ProvideFast1024
-    if (state->rate == 1024) {
-        KeccakExtract1024bits(state->state, state->dataQueue);
-        state->bitsAvailableForSqueezing = 1024;
-    }
-    else
-#endif
-    {
-        KeccakExtract(state->state, state->dataQueue, state->rate/64);
-        state->bitsAvailableForSqueezing = state->rate;
-    }
+    state->extract(state->state, state->dataQueue, state->rate/64);
+    state->bitsAvailableForSqueezing = state->rate;
     #ifdef KeccakReference
     displayBytes(1, "Block available for squeezing", state->dataQueue, state->bitsAvailableForSqueezing/8);
     #endif
@@ -238,19 +216,19 @@ int Squeeze(spongeState *state, unsigned char *output, unsigned long long output
 
     i = 0;
     while(i < outputLength) {
+        if ((state->bitsAvailableForSqueezing == 0) && (outputLength-i >= state->rate) && (((size_t)(output+i/8) % 8) == 0)) {
+            // Whole blocks go straight to the output, bypassing dataQueue
+            KeccakPermutationAndExtract(state->state, output+i/8, state->rate/64);
+            #ifdef KeccakReference
+            displayBytes(1, "Block available for squeezing", output+i/8, state->rate/8);
+            #endif
+            i += state->rate;
+            continue;
+        }
         if (state->bitsAvailableForSqueezing == 0) {
             KeccakPermutation(state->state);
-#ifdef ProvideFast1024
-            if (state->rate == 1024) {
-                KeccakExtract1024bits(state->state, state->dataQueue);
-                state->bitsAvailableForSqueezing = 1024;
-            }
-            else
-#endif
-            {
-                KeccakExtract(state->state, state->dataQueue, state->rate/64);
-                state->bitsAvailableForSqueezing = state->rate;
-            }
+            state->extract(state->state, state->dataQueue, state->rate/64);
+            state->bitsAvailableForSqueezing = state->rate;
             #ifdef KeccakReference
             displayBytes(1, "Block available for squeezing", state->dataQueue, state->bitsAvailableForSqueezing/8);
             #endif
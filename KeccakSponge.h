@@ -27,6 +27,9 @@ http://creativecommons.org/publicdomain/zero/1.0/
 #define ALIGN
 #endif
 
+typedef void (*KeccakAbsorbFunction)(unsigned char *state, const unsigned char *data, unsigned int laneCount);
+typedef void (*KeccakExtractFunction)(const unsigned char *state, unsigned char *data, unsigned int laneCount);
+
 ALIGN typedef struct spongeStateStruct {
     ALIGN unsigned char state[KeccakPermutationSizeInBytes];
     ALIGN unsigned char dataQueue[KeccakMaximumRateInBytes];
@@ -36,6 +39,9 @@ ALIGN typedef struct spongeStateStruct {
     unsigned int fixedOutputLength;
     int squeezing;
     unsigned int bitsAvailableForSqueezing;
+    // Block absorb and extract routines for the rate, chosen by InitSponge()
+    KeccakAbsorbFunction absorb;
+    KeccakExtractFunction extract;
 } spongeState;
 
 /**
@@ -0,0 +1,425 @@
+/*-
+ * Author: Gleb Kurtsou <gleb@FreeBSD.org>
+ *
+ * This software is hereby placed in the public domain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Keccak primitive microbenchmark.
+ *
+ * Measures cycles per call of KeccakPermutation(), of every fast
+ * KeccakAbsorb*bits() routine and of 512-bit in, 512-bit out Duplexing(),
+ * as mmcrypt uses it, and cycles per byte of sponge hashing.  Every
+ * primitive is run in batches: warm-up batches are discarded, batches
+ * above Q3 + 1.5 * IQR of the measured ones (interrupts, migrations) are
+ * rejected, and median, minimum and mean of the rest are reported.
+ *
+ * Cycles are read with rdtsc (reference cycles) on x86, with -P from the
+ * perf cycles counter (core cycles) instead.  Without either, time is
+ * reported in nanoseconds.  Keccak backend is chosen at link time,
+ * 'make keccak-bench-all' runs every backend and settings variant.
+ */
+
+#include <err.h>
+#include <libgen.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "KeccakF-1600-interface.h"
+#include "KeccakDuplex.h"
+#include "KeccakSponge.h"
+#include "mmcrypt-perf.h"
+
+#ifndef KECCAK_BENCH_BACKEND
+#define KECCAK_BENCH_BACKEND	KeccakImplementation()
+#endif
+
+#define KB_MSG_BYTES		16384
+
+enum kb_format {
+	KB_TEXT,
+	KB_CSV,
+};
+
+enum kb_clock {
+	KB_CLOCK_TSC,
+	KB_CLOCK_PERF,
+	KB_CLOCK_NS,
+};
+
+struct kb_state {
+	ALIGN unsigned char state[KeccakPermutationSizeInBytes];
+	ALIGN unsigned char data[KeccakMaximumRateInBytes];
+	ALIGN unsigned char out[KeccakMaximumRateInBytes];
+	duplexState duplex;
+	duplexState duplex12;
+	unsigned char *msg;
+};
+
+struct kb_primitive {
+	const char *name;
+	void (*run)(struct kb_state *, int);
+	unsigned int bytes;	/* input bytes per call */
+	int batched;		/* -b calls per sample, else one */
+};
+
+struct kb_result {
+	double median;
+	double min;
+	double mean;
+	int rejected;
+};
+
+static enum kb_clock kb_clock;
+static int kb_perf_fd = -1;
+
+static void
+kb_permutation(struct kb_state *k, int n)
+{
+	while (n-- > 0)
+		KeccakPermutation(k->state);
+}
+
+#define KB_ABSORB(rate)							\
+static void								\
+kb_absorb##rate(struct kb_state *k, int n)				\
+{									\
+	while (n-- > 0)							\
+		KeccakAbsorb##rate##bits(k->state, k->data);		\
+}
+#ifdef ProvideFast576
+KB_ABSORB(576)
+#endif
+#ifdef ProvideFast832
+KB_ABSORB(832)
+#endif
+#ifdef ProvideFast1024
+KB_ABSORB(1024)
+#endif
+#ifdef ProvideFast1088
+KB_ABSORB(1088)
+#endif
+#ifdef ProvideFast1152
+KB_ABSORB(1152)
+#endif
+#ifdef ProvideFast1344
+KB_ABSORB(1344)
+#endif
+
+static void
+kb_absorb576_r12(struct kb_state *k, int n)
+{
+	while (n-- > 0)
+		KeccakAbsorbRounds(k->state, k->data, 576 / 64, 12);
+}
+
+static void
+kb_duplex(struct kb_state *k, int n)
+{
+	while (n-- > 0)
+		Duplexing(&k->duplex, k->data, 512, k->out, 512);
+}
+
+static void
+kb_duplex_r12(struct kb_state *k, int n)
+{
+	while (n-- > 0)
+		Duplexing(&k->duplex12, k->data, 512, k->out, 512);
+}
+
+static void
+kb_sponge(struct kb_state *k, int n, unsigned int rate)
+{
+	spongeState ss;
+
+	while (n-- > 0) {
+		InitSponge(&ss, rate, 1600 - rate);
+		Absorb(&ss, k->msg, KB_MSG_BYTES * 8);
+		Squeeze(&ss, k->out, 512);
+	}
+}
+
+static void
+kb_sponge576(struct kb_state *k, int n)
+{
+	kb_sponge(k, n, 576);
+}
+
+static void
+kb_sponge1088(struct kb_state *k, int n)
+{
+	kb_sponge(k, n, 1088);
+}
+
+static const struct kb_primitive kb_primitives[] = {
+	{ "permutation", kb_permutation, 0, 1 },
+#ifdef ProvideFast576
+	{ "absorb576", kb_absorb576, 576 / 8, 1 },
+#endif
+#ifdef ProvideFast832
+	{ "absorb832", kb_absorb832, 832 / 8, 1 },
+#endif
+#ifdef ProvideFast1024
+	{ "absorb1024", kb_absorb1024, 1024 / 8, 1 },
+#endif
+#ifdef ProvideFast1088
+	{ "absorb1088", kb_absorb1088, 1088 / 8, 1 },
+#endif
+#ifdef ProvideFast1152
+	{ "absorb1152", kb_absorb1152, 1152 / 8, 1 },
+#endif
+#ifdef ProvideFast1344
+	{ "absorb1344", kb_absorb1344, 1344 / 8, 1 },
+#endif
+	{ "absorb576-r12", kb_absorb576_r12, 576 / 8, 1 },
+	{ "duplex512", kb_duplex, 512 / 8, 1 },
+	{ "duplex512-r12", kb_duplex_r12, 512 / 8, 1 },
+	{ "sponge576", kb_sponge576, KB_MSG_BYTES, 0 },
+	{ "sponge1088", kb_sponge1088, KB_MSG_BYTES, 0 },
+};
+
+#define KB_PRIMITIVES	((int)(sizeof(kb_primitives) / sizeof(kb_primitives[0])))
+
+static uint64_t
+kb_now(void)
+{
+	struct timespec ts;
+	uint64_t v;
+
+	switch (kb_clock) {
+#if defined(__x86_64__) || defined(__i386__)
+	case KB_CLOCK_TSC:
+		/* Keep the measured code from moving across the reads. */
+		_mm_lfence();
+		v = __rdtsc();
+		_mm_lfence();
+		return v;
+#endif
+	case KB_CLOCK_PERF:
+		if (read(kb_perf_fd, &v, sizeof(v)) != sizeof(v))
+			err(1, "perf counter read");
+		return v;
+	default:
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	}
+}
+
+static int
+kb_cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Sorts v, drops values above Q3 + 1.5 * IQR. */
+static void
+kb_stats(double *v, int n, struct kb_result *r)
+{
+	double q1, q3, sum;
+	int i, m;
+
+	qsort(v, n, sizeof(v[0]), kb_cmp);
+	q1 = v[n / 4];
+	q3 = v[(3 * n) / 4];
+	for (m = n; m > 1 && v[m - 1] > q3 + 1.5 * (q3 - q1); m--)
+		;
+	r->rejected = n - m;
+	r->min = v[0];
+	r->median = m % 2 == 0 ? (v[m / 2 - 1] + v[m / 2]) / 2 : v[m / 2];
+	for (i = 0, sum = 0; i < m; i++)
+		sum += v[i];
+	r->mean = sum / m;
+}
+
+static void
+kb_measure(const struct kb_primitive *p, struct kb_state *k, int batch,
+    int warmup, int samples, struct kb_result *r)
+{
+	uint64_t start;
+	double *v;
+	int i, n;
+
+	n = p->batched ? batch : 1;
+	v = calloc(samples, sizeof(v[0]));
+	if (v == NULL)
+		err(1, "calloc");
+	for (i = 0; i < warmup; i++)
+		p->run(k, n);
+	for (i = 0; i < samples; i++) {
+		start = kb_now();
+		p->run(k, n);
+		v[i] = (double)(kb_now() - start) / n;
+	}
+	kb_stats(v, samples, r);
+	free(v);
+}
+
+static void
+kb_print(enum kb_format fmt, const struct kb_primitive *p,
+    const struct kb_result *r, int samples)
+{
+	const char *unit;
+
+	unit = kb_clock == KB_CLOCK_NS ? "ns" :
+	    kb_clock == KB_CLOCK_PERF ? "cycles" : "tsc";
+	if (fmt == KB_CSV) {
+		printf("%s,%s,%s,%d,%d,%.1f,%.1f,%.1f,", KECCAK_BENCH_BACKEND,
+		    p->name, unit, samples, r->rejected, r->median, r->min,
+		    r->mean);
+		if (p->bytes != 0)
+			printf("%.3f\n", r->median / p->bytes);
+		else
+			printf("\n");
+		return;
+	}
+	printf("%-14s %-14s %-6s %7d %8d %10.1f %10.1f %10.1f ",
+	    KECCAK_BENCH_BACKEND, p->name, unit, samples, r->rejected,
+	    r->median, r->min, r->mean);
+	if (p->bytes != 0)
+		printf("%9.3f\n", r->median / p->bytes);
+	else
+		printf("%9s\n", "-");
+}
+
+static void
+kb_print_header(enum kb_format fmt)
+{
+	if (fmt == KB_CSV) {
+		printf("backend,primitive,unit,samples,rejected,median,min,"
+		    "mean,per_byte\n");
+		return;
+	}
+	printf("%-14s %-14s %-6s %7s %8s %10s %10s %10s %9s\n", "backend",
+	    "primitive", "unit", "samples", "rejected", "median", "min",
+	    "mean", "per-byte");
+}
+
+static void
+usage(const char *prog)
+{
+	fprintf(stderr,
+	    "usage: %s [-HP] [-f text|csv] [-n samples] [-w warmup]\n"
+	    "       [-b calls-per-sample] [primitive ...]\n", prog);
+	exit(-1);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct perf_counters pc;
+	struct kb_result r;
+	struct kb_state *k;
+	enum kb_format fmt = KB_TEXT;
+	const char *prog = basename(argv[0]);
+	int samples = 201, warmup = 20, batch = 16;
+	int header = 1, perf = 0;
+	int ch, i, j, found;
+	size_t n;
+
+	while ((ch = getopt(argc, argv, "HPb:f:n:w:")) != -1) {
+		switch (ch) {
+		case 'H':
+			header = 0;
+			break;
+		case 'P':
+			perf = 1;
+			break;
+		case 'b':
+			batch = atoi(optarg);
+			break;
+		case 'f':
+			if (strcmp(optarg, "text") == 0)
+				fmt = KB_TEXT;
+			else if (strcmp(optarg, "csv") == 0)
+				fmt = KB_CSV;
+			else
+				usage(prog);
+			break;
+		case 'n':
+			samples = atoi(optarg);
+			break;
+		case 'w':
+			warmup = atoi(optarg);
+			break;
+		default:
+			usage(prog);
+		}
+	}
+	if (samples < 4 || warmup < 0 || batch < 1)
+		usage(prog);
+	for (j = optind; j < argc; j++) {
+		for (i = 0; i < KB_PRIMITIVES; i++)
+			if (strcmp(argv[j], kb_primitives[i].name) == 0)
+				break;
+		if (i == KB_PRIMITIVES)
+			errx(1, "unknown primitive %s", argv[j]);
+	}
+
+#if defined(__x86_64__) || defined(__i386__)
+	kb_clock = KB_CLOCK_TSC;
+#else
+	kb_clock = KB_CLOCK_NS;
+#endif
+	if (perf) {
+		if (perf_open(&pc) == 0 || pc.fd[PERF_CYCLES] < 0)
+			errx(1, "perf cycles counter is not available");
+		kb_perf_fd = pc.fd[PERF_CYCLES];
+		kb_clock = KB_CLOCK_PERF;
+	}
+
+	k = aligned_alloc(32, sizeof(*k));
+	if (k == NULL)
+		err(1, "aligned_alloc");
+	memset(k, 0, sizeof(*k));
+	k->msg = malloc(KB_MSG_BYTES);
+	if (k->msg == NULL)
+		err(1, "malloc");
+	for (n = 0; n < sizeof(k->data); n++)
+		k->data[n] = n * 7 + 1;
+	for (n = 0; n < KB_MSG_BYTES; n++)
+		k->msg[n] = n * 13 + 5;
+	KeccakInitialize();
+	KeccakInitializeState(k->state);
+	if (InitDuplex(&k->duplex, 576, 1024) != 0 ||
+	    InitDuplexRounds(&k->duplex12, 576, 1024, 12) != 0)
+		errx(1, "InitDuplex failed");
+
+	if (header)
+		kb_print_header(fmt);
+	for (i = 0; i < KB_PRIMITIVES; i++) {
+		found = optind == argc;
+		for (j = optind; j < argc && !found; j++)
+			found = strcmp(argv[j], kb_primitives[i].name) == 0;
+		if (!found)
+			continue;
+		kb_measure(&kb_primitives[i], k, batch, warmup, samples, &r);
+		kb_print(fmt, &kb_primitives[i], &r, samples);
+	}
+
+	if (perf)
+		perf_close(&pc);
+	free(k->msg);
+	free(k);
+	return 0;
+}
@@ -0,0 +1,792 @@
+/*-
+ * Author: Gleb Kurtsou <gleb@FreeBSD.org>
+ *
+ * This software is hereby placed in the public domain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Parametric mmcrypt_stretch() benchmark.
+ *
+ * Sweeps a grid of (iter, c, s), runs warm-up and measured repetitions of
+ * every point and reports median, p90, p99 and median absolute deviation
+ * of the stretch time together with fill and traversal rates.  Keccak
+ * backend is chosen at link time, 'make bench' runs every backend.
+ *
+ * Results are printed as text, CSV or JSON lines.  CSV output may be saved
+ * and passed back with -b to detect regressions against it.
+ *
+ * With -t every point is run concurrently on each listed number of
+ * threads, pinned to distinct CPUs, to measure aggregate throughput,
+ * latency under load and the thread count after which adding threads
+ * stops paying off (parallel efficiency drops below -E).
+ *
+ * -R 12 measures the reduced-round table fill variant instead, -L the
+ * given table row width in bytes, -l lane the lane-major table layout.
+ * Every result records rounds, width, layout and -M memory policy, and
+ * is only compared with baseline results of the same settings.
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <err.h>
+#include <errno.h>
+#include <libgen.h>
+#include <pthread.h>
+#if defined(__linux__)
+#include <sched.h>
+#elif defined(__FreeBSD__)
+#include <pthread_np.h>
+#include <sys/cpuset.h>
+#endif
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mmcrypt.h"
+#include "mmcrypt-numa.h"
+#include "KeccakF-1600-interface.h"
+
+/* Lists grow as needed, the limit only catches runaway ranges. */
+#define BENCH_LIST_MAX		65536
+/* Columns of -f csv output, older baselines don't match. */
+#define BENCH_CSV_FIELDS	18
+
+enum bench_format {
+	BENCH_TEXT,
+	BENCH_CSV,
+	BENCH_JSON,
+};
+
+struct bench_list {
+	uint32_t *v;
+	int n;
+	int size;
+};
+
+struct bench_stats {
+	double median;
+	double p90;
+	double p99;
+	double mad;
+};
+
+struct bench_result {
+	const char *backend;
+	uint32_t iter, c, s;
+	uint32_t rounds, width;
+	const char *layout, *mempolicy;
+	int reps;
+	struct bench_stats total;
+	double fill;
+	double traverse;
+	double rows_per_sec;
+	double steps_per_sec;
+	double gbps;
+};
+
+struct bench_scale_result {
+	const char *backend;
+	uint32_t iter, c, s;
+	uint32_t rounds, width;
+	const char *layout, *mempolicy;
+	uint32_t threads;
+	int reps;
+	struct bench_stats latency;
+	double stretches_per_sec;
+	double efficiency;
+};
+
+struct bench_thread {
+	pthread_t td;
+	pthread_barrier_t *barrier;
+	uint32_t iter, c, s;
+	int cpu;
+	int warmup, reps;
+	double *latency;
+	double end;
+};
+
+struct bench_phase {
+	double start[MMCRYPT_PHASE_MAX];
+	double total[MMCRYPT_PHASE_MAX];
+};
+
+static double
+bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+bench_hook(void *arg, enum mmcrypt_phase phase, int end)
+{
+	struct bench_phase *bp = arg;
+
+	if (end)
+		bp->total[phase] += bench_now() - bp->start[phase];
+	else
+		bp->start[phase] = bench_now();
+}
+
+static int
+bench_cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Nearest rank percentile of sorted array. */
+static double
+bench_percentile(const double *v, int n, int p)
+{
+	int i;
+
+	i = (n * p + 99) / 100;
+	if (i < 1)
+		i = 1;
+	return v[i - 1];
+}
+
+static double
+bench_median(double *v, int n)
+{
+	qsort(v, n, sizeof(v[0]), bench_cmp);
+	if (n % 2 == 0)
+		return (v[n / 2 - 1] + v[n / 2]) / 2;
+	return v[n / 2];
+}
+
+static void
+bench_stats(double *v, int n, struct bench_stats *st)
+{
+	double *dev;
+	int i;
+
+	dev = malloc(n * sizeof(dev[0]));
+	if (dev == NULL)
+		err(1, "malloc");
+	st->median = bench_median(v, n);
+	st->p90 = bench_percentile(v, n, 90);
+	st->p99 = bench_percentile(v, n, 99);
+	for (i = 0; i < n; i++)
+		dev[i] = v[i] > st->median ? v[i] - st->median :
+		    st->median - v[i];
+	st->mad = bench_median(dev, n);
+	free(dev);
+}
+
+static struct mmcrypt_ctx bench_prefix;
+static uint32_t bench_rounds;
+static uint32_t bench_width;
+static enum mmcrypt_layout bench_layout;
+static enum mmcrypt_mempolicy bench_mempolicy;
+
+static const char *bench_layout_names[] = {
+	[MMCRYPT_LAYOUT_ROW] = "row",
+	[MMCRYPT_LAYOUT_LANE] = "lane",
+};
+
+static const char *bench_mempolicy_names[] = {
+	[MMCRYPT_MEM_LOCAL] = "local",
+	[MMCRYPT_MEM_INTERLEAVE] = "interleave",
+	[MMCRYPT_MEM_DEFAULT] = "default",
+};
+
+static int
+bench_stretch(uint32_t iter, uint32_t c, uint32_t s, struct bench_phase *bp)
+{
+	const struct mmcrypt_params p = { .iter = iter, .c = c, .s = s,
+	    .rounds = bench_rounds, .width = bench_width };
+	struct mmcrypt_ctx ctx;
+	int rv = 0;
+
+	/* Static prefix is absorbed once in main(). */
+	mmcrypt_ctx_clone(&ctx, &bench_prefix);
+	rv |= mmcrypt_absorb(&ctx, "salt", strlen("salt"));
+	rv |= mmcrypt_absorb(&ctx, "tag", strlen("tag"));
+	rv |= mmcrypt_absorb(&ctx, "password", strlen("password"));
+	if (bp != NULL)
+		mmcrypt_set_hook(&ctx, bench_hook, bp);
+	rv |= mmcrypt_stretch_params(&ctx, &p);
+	mmcrypt_destroy(&ctx);
+	return rv;
+}
+
+static void
+bench_run(struct bench_result *r, int warmup, int reps)
+{
+	const double rows = (double)(1ULL << (r->c + 1)) * r->s * r->iter;
+	const double steps = (double)((1ULL << (2 * r->c)) - 1) * r->s *
+	    r->iter;
+	struct bench_phase bp;
+	double *total, *fill, *traverse;
+	int i;
+
+	total = calloc(reps * 3, sizeof(total[0]));
+	if (total == NULL)
+		err(1, "calloc");
+	fill = total + reps;
+	traverse = fill + reps;
+	for (i = 0; i < warmup + reps; i++) {
+		memset(&bp, 0, sizeof(bp));
+		if (bench_stretch(r->iter, r->c, r->s, &bp) != 0)
+			errx(1, "mmcrypt(%u, %u, %u): mmcrypt_stretch failed",
+			    r->iter, r->c, r->s);
+		if (i < warmup)
+			continue;
+		total[i - warmup] = bp.total[MMCRYPT_PHASE_STRETCH];
+		fill[i - warmup] = bp.total[MMCRYPT_PHASE_FILL];
+		traverse[i - warmup] = bp.total[MMCRYPT_PHASE_TRAVERSE];
+	}
+	r->backend = KeccakImplementation();
+	r->rounds = bench_rounds != 0 ? bench_rounds : MMCRYPT_ROUNDS_FULL;
+	r->width = bench_width != 0 ? bench_width : MMCRYPT_WIDTH_MIN;
+	r->layout = bench_layout_names[bench_layout];
+	r->mempolicy = bench_mempolicy_names[bench_mempolicy];
+	r->reps = reps;
+	bench_stats(total, reps, &r->total);
+	r->fill = bench_median(fill, reps);
+	r->traverse = bench_median(traverse, reps);
+	r->rows_per_sec = r->fill > 0 ? rows / r->fill : 0;
+	r->steps_per_sec = r->traverse > 0 ? steps / r->traverse : 0;
+	/* Every traversal step reads two rows from each table. */
+	r->gbps = r->traverse > 0 ?
+	    steps * 4 * r->width / r->traverse / 1e9 : 0;
+	free(total);
+}
+
+static void
+bench_print_header(enum bench_format fmt)
+{
+	switch (fmt) {
+	case BENCH_TEXT:
+		printf("%-10s %4s %3s %6s %6s %5s %6s %10s %5s %11s %11s "
+		    "%11s %11s %11s %11s %11s\n",
+		    "backend", "iter", "c", "s", "rounds", "width", "layout",
+		    "mempolicy", "reps", "median",
+		    "p90", "p99", "mad", "rows/s", "steps/s", "GB/s");
+		break;
+	case BENCH_CSV:
+		printf("backend,iter,c,s,rounds,width,layout,mempolicy,reps,"
+		    "median_s,p90_s,p99_s,mad_s,"
+		    "fill_s,traverse_s,rows_per_s,steps_per_s,gbps\n");
+		break;
+	case BENCH_JSON:
+		break;
+	}
+}
+
+static void
+bench_print(enum bench_format fmt, const struct bench_result *r)
+{
+	switch (fmt) {
+	case BENCH_TEXT:
+		printf("%-10s %4u %3u %6u %6u %5u %6s %10s %5d %11.6lf "
+		    "%11.6lf %11.6lf %11.6lf %11.4le %11.4le %11.3lf\n",
+		    r->backend, r->iter, r->c, r->s, r->rounds, r->width,
+		    r->layout, r->mempolicy, r->reps,
+		    r->total.median, r->total.p90, r->total.p99, r->total.mad,
+		    r->rows_per_sec, r->steps_per_sec, r->gbps);
+		break;
+	case BENCH_CSV:
+		printf("%s,%u,%u,%u,%u,%u,%s,%s,%d,%.9lf,%.9lf,%.9lf,%.9lf,"
+		    "%.9lf,%.9lf,%.6le,%.6le,%.6lf\n",
+		    r->backend, r->iter, r->c, r->s, r->rounds, r->width,
+		    r->layout, r->mempolicy, r->reps,
+		    r->total.median, r->total.p90, r->total.p99, r->total.mad,
+		    r->fill, r->traverse,
+		    r->rows_per_sec, r->steps_per_sec, r->gbps);
+		break;
+	case BENCH_JSON:
+		printf("{\"backend\": \"%s\", \"iter\": %u, \"c\": %u, "
+		    "\"s\": %u, \"rounds\": %u, \"width\": %u, "
+		    "\"layout\": \"%s\", \"mempolicy\": \"%s\", "
+		    "\"reps\": %d, \"median_s\": %.9lf, \"p90_s\": %.9lf, "
+		    "\"p99_s\": %.9lf, \"mad_s\": %.9lf, "
+		    "\"fill_s\": %.9lf, \"traverse_s\": %.9lf, "
+		    "\"rows_per_s\": %.6le, \"steps_per_s\": %.6le, "
+		    "\"gbps\": %.6lf}\n",
+		    r->backend, r->iter, r->c, r->s, r->rounds, r->width,
+		    r->layout, r->mempolicy, r->reps,
+		    r->total.median, r->total.p90, r->total.p99, r->total.mad,
+		    r->fill, r->traverse,
+		    r->rows_per_sec, r->steps_per_sec, r->gbps);
+		break;
+	}
+	fflush(stdout);
+}
+
+/*
+ * Look up median of the same backend, (iter, c, s), rounds, width, layout
+ * and mempolicy in CSV baseline produced by -f csv.  Returns 0 if found.
+ */
+static int
+bench_baseline(FILE *f, const struct bench_result *r, double *median)
+{
+	char line[512], backend[64], layout[16], mempolicy[16];
+	unsigned int iter, c, s, rounds, width;
+	const char *p;
+	int fields, reps;
+
+	rewind(f);
+	while (fgets(line, sizeof(line), f) != NULL) {
+		for (p = line, fields = 1; *p != '\0'; p++)
+			fields += *p == ',';
+		if (fields != BENCH_CSV_FIELDS ||
+		    sscanf(line, "%63[^,],%u,%u,%u,%u,%u,%15[^,],%15[^,],%d,%lf",
+		    backend, &iter, &c, &s, &rounds, &width, layout, mempolicy,
+		    &reps, median) != 10)
+			continue;
+		if (strcmp(backend, r->backend) == 0 &&
+		    iter == r->iter && c == r->c && s == r->s &&
+		    rounds == r->rounds && width == r->width &&
+		    strcmp(layout, r->layout) == 0 &&
+		    strcmp(mempolicy, r->mempolicy) == 0)
+			return 0;
+	}
+	return 1;
+}
+
+static int
+bench_compare(FILE *f, const struct bench_result *r, double threshold)
+{
+	double base, delta;
+
+	if (bench_baseline(f, r, &base) != 0 || base <= 0) {
+		fprintf(stderr, "mmcrypt(%u, %u, %u) %s: no baseline\n",
+		    r->iter, r->c, r->s, r->backend);
+		return 0;
+	}
+	delta = (r->total.median - base) / base * 100;
+	fprintf(stderr, "mmcrypt(%u, %u, %u) %s: %.6lf sec, baseline "
+	    "%.6lf sec, %+.2lf%%%s\n",
+	    r->iter, r->c, r->s, r->backend, r->total.median, base, delta,
+	    delta > threshold ? " REGRESSION" : "");
+	return delta > threshold;
+}
+
+static void
+bench_pin(int cpu)
+{
+#if defined(__linux__)
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#elif defined(__FreeBSD__)
+	cpuset_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+static void *
+bench_thread_main(void *arg)
+{
+	struct bench_thread *bt = arg;
+	double t;
+	int i;
+
+	bench_pin(bt->cpu);
+	for (i = 0; i < bt->warmup; i++)
+		if (bench_stretch(bt->iter, bt->c, bt->s, NULL) != 0)
+			errx(1, "mmcrypt(%u, %u, %u): mmcrypt_stretch failed",
+			    bt->iter, bt->c, bt->s);
+	pthread_barrier_wait(bt->barrier);
+	for (i = 0; i < bt->reps; i++) {
+		t = bench_now();
+		if (bench_stretch(bt->iter, bt->c, bt->s, NULL) != 0)
+			errx(1, "mmcrypt(%u, %u, %u): mmcrypt_stretch failed",
+			    bt->iter, bt->c, bt->s);
+		bt->latency[i] = bench_now() - t;
+	}
+	bt->end = bench_now();
+	return NULL;
+}
+
+static void
+bench_scale_run(struct bench_scale_result *r, int warmup, int reps)
+{
+	struct bench_thread *bt;
+	pthread_barrier_t barrier;
+	double *latency;
+	double start, end;
+	int *cpus;
+	long ncpu;
+	uint32_t i;
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu < 1)
+		ncpu = 1;
+	bt = calloc(r->threads, sizeof(bt[0]));
+	latency = calloc((size_t)r->threads * reps, sizeof(latency[0]));
+	cpus = calloc(ncpu, sizeof(cpus[0]));
+	if (bt == NULL || latency == NULL || cpus == NULL)
+		err(1, "calloc");
+	/* Threads alternate between NUMA nodes. */
+	ncpu = mmcrypt_numa_cpu_order(cpus, ncpu);
+	if (ncpu < 1)
+		errx(1, "no online CPUs");
+	/* Main thread joins the barrier to start the clock. */
+	pthread_barrier_init(&barrier, NULL, r->threads + 1);
+	for (i = 0; i < r->threads; i++) {
+		bt[i].barrier = &barrier;
+		bt[i].iter = r->iter;
+		bt[i].c = r->c;
+		bt[i].s = r->s;
+		bt[i].cpu = cpus[i % ncpu];
+		bt[i].warmup = warmup;
+		bt[i].reps = reps;
+		bt[i].latency = &latency[(size_t)i * reps];
+		if (pthread_create(&bt[i].td, NULL, bench_thread_main,
+		    &bt[i]) != 0)
+			errx(1, "pthread_create failed");
+	}
+	pthread_barrier_wait(&barrier);
+	start = bench_now();
+	end = start;
+	for (i = 0; i < r->threads; i++) {
+		pthread_join(bt[i].td, NULL);
+		if (bt[i].end > end)
+			end = bt[i].end;
+	}
+	pthread_barrier_destroy(&barrier);
+	r->backend = KeccakImplementation();
+	r->rounds = bench_rounds != 0 ? bench_rounds : MMCRYPT_ROUNDS_FULL;
+	r->width = bench_width != 0 ? bench_width : MMCRYPT_WIDTH_MIN;
+	r->layout = bench_layout_names[bench_layout];
+	r->mempolicy = bench_mempolicy_names[bench_mempolicy];
+	r->reps = reps;
+	r->stretches_per_sec = end > start ?
+	    (double)r->threads * reps / (end - start) : 0;
+	bench_stats(latency, r->threads * reps, &r->latency);
+	free(latency);
+	free(bt);
+	free(cpus);
+}
+
+static void
+bench_scale_print_header(enum bench_format fmt)
+{
+	switch (fmt) {
+	case BENCH_TEXT:
+		printf("%-10s %4s %3s %6s %6s %5s %6s %10s %7s %5s %11s "
+		    "%11s %11s %11s %11s %6s %4s\n",
+		    "backend", "iter", "c", "s", "rounds", "width", "layout",
+		    "mempolicy", "threads", "reps",
+		    "stretches/s", "median", "p90", "p99", "mad", "eff",
+		    "knee");
+		break;
+	case BENCH_CSV:
+		printf("backend,iter,c,s,rounds,width,layout,mempolicy,threads,"
+		    "reps,stretches_per_s,"
+		    "median_s,p90_s,p99_s,mad_s,efficiency,knee\n");
+		break;
+	case BENCH_JSON:
+		break;
+	}
+}
+
+static void
+bench_scale_print(enum bench_format fmt, const struct bench_scale_result *r,
+    uint32_t knee)
+{
+	switch (fmt) {
+	case BENCH_TEXT:
+		printf("%-10s %4u %3u %6u %6u %5u %6s %10s %7u %5d %11.3lf "
+		    "%11.6lf %11.6lf %11.6lf %11.6lf %6.3lf %4u\n",
+		    r->backend, r->iter, r->c, r->s, r->rounds, r->width,
+		    r->layout, r->mempolicy, r->threads, r->reps,
+		    r->stretches_per_sec, r->latency.median, r->latency.p90,
+		    r->latency.p99, r->latency.mad, r->efficiency, knee);
+		break;
+	case BENCH_CSV:
+		printf("%s,%u,%u,%u,%u,%u,%s,%s,%u,%d,%.6lf,%.9lf,%.9lf,"
+		    "%.9lf,%.9lf,%.6lf,%u\n",
+		    r->backend, r->iter, r->c, r->s, r->rounds, r->width,
+		    r->layout, r->mempolicy, r->threads, r->reps,
+		    r->stretches_per_sec, r->latency.median, r->latency.p90,
+		    r->latency.p99, r->latency.mad, r->efficiency, knee);
+		break;
+	case BENCH_JSON:
+		printf("{\"backend\": \"%s\", \"iter\": %u, \"c\": %u, "
+		    "\"s\": %u, \"rounds\": %u, \"width\": %u, "
+		    "\"layout\": \"%s\", \"mempolicy\": \"%s\", "
+		    "\"threads\": %u, \"reps\": %d, "
+		    "\"stretches_per_s\": %.6lf, \"median_s\": %.9lf, "
+		    "\"p90_s\": %.9lf, \"p99_s\": %.9lf, \"mad_s\": %.9lf, "
+		    "\"efficiency\": %.6lf, \"knee\": %u}\n",
+		    r->backend, r->iter, r->c, r->s, r->rounds, r->width,
+		    r->layout, r->mempolicy, r->threads, r->reps,
+		    r->stretches_per_sec, r->latency.median, r->latency.p90,
+		    r->latency.p99, r->latency.mad, r->efficiency, knee);
+		break;
+	}
+	fflush(stdout);
+}
+
+/*
+ * Run one (iter, c, s) point on every thread count of the list.
+ * Efficiency is throughput relative to linear scaling of the smallest
+ * thread count, knee is the largest thread count before efficiency
+ * first drops below min_eff.
+ */
+static void
+bench_scale(enum bench_format fmt, const struct bench_list *threads,
+    uint32_t iter, uint32_t c, uint32_t s, int warmup, int reps,
+    double min_eff)
+{
+	struct bench_scale_result *r;
+	double base;
+	uint32_t knee;
+	int i;
+
+	r = calloc(threads->n, sizeof(r[0]));
+	if (r == NULL)
+		err(1, "calloc");
+	knee = 0;
+	for (i = 0; i < threads->n; i++) {
+		memset(&r[i], 0, sizeof(r[i]));
+		r[i].iter = iter;
+		r[i].c = c;
+		r[i].s = s;
+		r[i].threads = threads->v[i];
+		bench_scale_run(&r[i], warmup, reps);
+		base = r[0].stretches_per_sec / r[0].threads;
+		r[i].efficiency = base > 0 ?
+		    r[i].stretches_per_sec / (base * r[i].threads) : 0;
+		if (knee == 0 && r[i].efficiency < min_eff)
+			knee = i > 0 ? r[i - 1].threads : r[0].threads;
+	}
+	if (knee == 0)
+		knee = r[threads->n - 1].threads;
+	for (i = 0; i < threads->n; i++)
+		bench_scale_print(fmt, &r[i], knee);
+	free(r);
+}
+
+/* Parse comma separated list of values and inclusive ranges "a-b". */
+static void
+bench_parse_list(struct bench_list *l, const char *arg, const char *name)
+{
+	unsigned long a, b;
+	uint32_t *v;
+	char *p, *end;
+
+	l->n = 0;
+	p = (char *)arg;
+	while (*p != '\0') {
+		errno = 0;
+		a = strtoul(p, &end, 10);
+		b = a;
+		if (end != p && *end == '-')
+			b = strtoul(end + 1, &end, 10);
+		if (errno != 0 || end == p || a == 0 || b < a ||
+		    b > UINT32_MAX || (*end != ',' && *end != '\0'))
+			errx(1, "invalid %s list: %s", name, arg);
+		for (; a <= b; a++) {
+			if (l->n == BENCH_LIST_MAX)
+				errx(1, "%s list is too long: %s", name, arg);
+			if (l->n == l->size) {
+				v = reallocarray(l->v, l->size * 2 + 16,
+				    sizeof(l->v[0]));
+				if (v == NULL)
+					err(1, "reallocarray");
+				l->v = v;
+				l->size = l->size * 2 + 16;
+			}
+			l->v[l->n++] = a;
+		}
+		p = *end == ',' ? end + 1 : end;
+	}
+	if (l->n == 0)
+		errx(1, "empty %s list", name);
+}
+
+static void
+usage(const char *prog)
+{
+	fprintf(stderr,
+	    "usage: %s [-H] [-f text|csv|json] [-n reps] [-w warmup]\n"
+	    "       [-i iter-list] [-c c-list] [-s s-list]\n"
+	    "       [-b baseline.csv] [-T threshold-percent]\n"
+	    "       [-t thread-list [-E min-efficiency]]\n"
+	    "       [-M local|interleave|default] [-R 24|12] [-L row-bytes]\n"
+	    "       [-l row|lane]\n", prog);
+	exit(-1);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct bench_list iters = { NULL }, cs = { NULL }, ss = { NULL };
+	struct bench_list threads = { NULL };
+	struct bench_result r;
+	enum bench_format fmt = BENCH_TEXT;
+	const char *prog = basename(argv[0]);
+	FILE *baseline = NULL;
+	unsigned long width;
+	char *end;
+	double threshold = 5;
+	double min_eff = 0.8;
+	int reps = 10, warmup = 2;
+	int header = 1, regressions = 0;
+	int ch, i, j, k;
+
+	bench_parse_list(&iters, "1", "iter");
+	bench_parse_list(&cs, "4-8", "c");
+	bench_parse_list(&ss, "337", "s");
+	while ((ch = getopt(argc, argv, "E:HL:M:R:b:c:f:i:l:n:s:T:t:w:")) != -1) {
+		switch (ch) {
+		case 'E':
+			min_eff = atof(optarg);
+			break;
+		case 'H':
+			header = 0;
+			break;
+		case 'M':
+			if (strcmp(optarg, "local") == 0)
+				bench_mempolicy = MMCRYPT_MEM_LOCAL;
+			else if (strcmp(optarg, "interleave") == 0)
+				bench_mempolicy = MMCRYPT_MEM_INTERLEAVE;
+			else if (strcmp(optarg, "default") == 0)
+				bench_mempolicy = MMCRYPT_MEM_DEFAULT;
+			else
+				usage(prog);
+			break;
+		case 'L':
+			errno = 0;
+			width = strtoul(optarg, &end, 10);
+			if (errno != 0 || end == optarg || *end != '\0' ||
+			    width < MMCRYPT_WIDTH_MIN ||
+			    width > MMCRYPT_WIDTH_MAX ||
+			    (width & (width - 1)) != 0)
+				errx(1, "row width must be a power of 2 in "
+				    "range %d-%d", MMCRYPT_WIDTH_MIN,
+				    MMCRYPT_WIDTH_MAX);
+			bench_width = width;
+			break;
+		case 'R':
+			bench_rounds = atoi(optarg);
+			if (bench_rounds != MMCRYPT_ROUNDS_FULL &&
+			    bench_rounds != MMCRYPT_ROUNDS_REDUCED)
+				usage(prog);
+			break;
+		case 'b':
+			baseline = fopen(optarg, "r");
+			if (baseline == NULL)
+				err(1, "%s", optarg);
+			break;
+		case 'c':
+			bench_parse_list(&cs, optarg, "c");
+			break;
+		case 'f':
+			if (strcmp(optarg, "text") == 0)
+				fmt = BENCH_TEXT;
+			else if (strcmp(optarg, "csv") == 0)
+				fmt = BENCH_CSV;
+			else if (strcmp(optarg, "json") == 0)
+				fmt = BENCH_JSON;
+			else
+				usage(prog);
+			break;
+		case 'i':
+			bench_parse_list(&iters, optarg, "iter");
+			break;
+		case 'l':
+			if (strcmp(optarg, "row") == 0)
+				bench_layout = MMCRYPT_LAYOUT_ROW;
+			else if (strcmp(optarg, "lane") == 0)
+				bench_layout = MMCRYPT_LAYOUT_LANE;
+			else
+				usage(prog);
+			break;
+		case 'n':
+			reps = atoi(optarg);
+			break;
+		case 's':
+			bench_parse_list(&ss, optarg, "s");
+			break;
+		case 'T':
+			threshold = atof(optarg);
+			break;
+		case 't':
+			bench_parse_list(&threads, optarg, "thread");
+			break;
+		case 'w':
+			warmup = atoi(optarg);
+			break;
+		default:
+			usage(prog);
+		}
+	}
+	if (optind != argc || reps < 1 || warmup < 0 ||
+	    (threads.n != 0 && baseline != NULL))
+		usage(prog);
+	for (i = 0; i < cs.n; i++)
+		if (cs.v[i] > 31)
+			errx(1, "c must be in range 1-31");
+
+	mmcrypt_init(&bench_prefix);
+	mmcrypt_set_mempolicy(&bench_prefix, bench_mempolicy);
+	mmcrypt_set_layout(&bench_prefix, bench_layout);
+	if (mmcrypt_absorb(&bench_prefix, "pepper", strlen("pepper")) != 0)
+		errx(1, "mmcrypt_absorb failed");
+
+	if (header && threads.n != 0)
+		bench_scale_print_header(fmt);
+	else if (header)
+		bench_print_header(fmt);
+	for (i = 0; i < iters.n; i++) {
+		for (j = 0; j < cs.n; j++) {
+			for (k = 0; k < ss.n; k++) {
+				if (threads.n != 0) {
+					bench_scale(fmt, &threads, iters.v[i],
+					    cs.v[j], ss.v[k], warmup, reps,
+					    min_eff);
+					continue;
+				}
+				memset(&r, 0, sizeof(r));
+				r.iter = iters.v[i];
+				r.c = cs.v[j];
+				r.s = ss.v[k];
+				bench_run(&r, warmup, reps);
+				bench_print(fmt, &r);
+				if (baseline != NULL)
+					regressions += bench_compare(baseline,
+					    &r, threshold);
+			}
+		}
+	}
+	if (baseline != NULL)
+		fclose(baseline);
+	free(iters.v);
+	free(cs.v);
+	free(ss.v);
+	free(threads.v);
+	return regressions != 0 ? 2 : 0;
+}
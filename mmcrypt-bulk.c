@@ -0,0 +1,400 @@
+/*-
+ * Author: Gleb Kurtsou <gleb@FreeBSD.org>
+ *
+ * This software is hereby placed in the public domain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Offline bulk key derivation, e.g. rehashing a credential database after
+ * changing parameters.
+ *
+ * Every input line is a record of whitespace separated fields:
+ *
+ *	iter c s salt tag password
+ *
+ * salt, tag and password are hex encoded, "-" is empty, up to
+ * BULK_FIELD_MAX bytes each.  Fields longer than MMCRYPT_ABSORB_MAX bytes
+ * are absorbed with mmcrypt_absorb_begin/update/final(), as in mmcryptd.
+ * Blank lines and lines starting with '#' are skipped.  The key of every
+ * record is written as a hex line in input order.
+ *
+ * Input is mmap'd and parsed by the main thread, stretching runs on an
+ * mmcrypt_pool reusing worker table memory between records.  At most
+ * -W records are in flight; a completed record waits in the reorder
+ * window until all records before it are written.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mmcrypt.h"
+#include "mmcrypt-pool.h"
+
+#define BULK_FIELD_MAX		1024
+#define BULK_KEY_MAX		4096
+
+struct bulk_slot {
+	struct mmcrypt_ctx ctx;
+	uint64_t line;
+	int status;
+	int done;
+};
+
+struct bulk_input {
+	const char *p;
+	const char *end;
+	uint64_t line;
+};
+
+static double
+bulk_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+bulk_hexval(int ch)
+{
+	if (ch >= '0' && ch <= '9')
+		return ch - '0';
+	if (ch >= 'a' && ch <= 'f')
+		return ch - 'a' + 10;
+	if (ch >= 'A' && ch <= 'F')
+		return ch - 'A' + 10;
+	return -1;
+}
+
+/* Returns decoded length or -1. */
+static int
+bulk_unhex(const char *s, size_t len, unsigned char *out)
+{
+	size_t i;
+	int hi, lo;
+
+	if (len == 1 && s[0] == '-')
+		return 0;
+	if (len % 2 != 0 || len / 2 > BULK_FIELD_MAX)
+		return -1;
+	for (i = 0; i < len / 2; i++) {
+		hi = bulk_hexval(s[2 * i]);
+		lo = bulk_hexval(s[2 * i + 1]);
+		if (hi < 0 || lo < 0)
+			return -1;
+		out[i] = hi << 4 | lo;
+	}
+	return len / 2;
+}
+
+static int
+bulk_field(const char **pp, const char *end, const char **f, size_t *flen)
+{
+	const char *p = *pp;
+
+	while (p < end && (*p == ' ' || *p == '\t'))
+		p++;
+	*f = p;
+	while (p < end && *p != ' ' && *p != '\t' && *p != '\n')
+		p++;
+	*flen = p - *f;
+	*pp = p;
+	return *flen == 0;
+}
+
+static uint32_t
+bulk_number(const char *f, size_t flen)
+{
+	uint32_t v = 0;
+	size_t i;
+
+	if (flen == 0 || flen > 9)
+		return 0;
+	for (i = 0; i < flen; i++) {
+		if (f[i] < '0' || f[i] > '9')
+			return 0;
+		v = v * 10 + f[i] - '0';
+	}
+	return v;
+}
+
+static int
+bulk_absorb(struct mmcrypt_ctx *ctx, const void *data, size_t len)
+{
+	if (len <= MMCRYPT_ABSORB_MAX)
+		return mmcrypt_absorb(ctx, data, len);
+	if (mmcrypt_absorb_begin(ctx) != 0 ||
+	    mmcrypt_absorb_update(ctx, data, len) != 0)
+		return 1;
+	return mmcrypt_absorb_final(ctx);
+}
+
+/*
+ * Parse next record, absorb it into ctx.  Returns 0 on success, 1 at end
+ * of input, exits on malformed records.
+ */
+static int
+bulk_next(struct bulk_input *in, struct mmcrypt_ctx *ctx,
+    struct mmcrypt_params *p)
+{
+	unsigned char buf[BULK_FIELD_MAX];
+	const char *f, *eol;
+	size_t flen;
+	uint32_t v[3];
+	int i, len;
+
+	for (;;) {
+		if (in->p >= in->end)
+			return 1;
+		in->line++;
+		eol = memchr(in->p, '\n', in->end - in->p);
+		if (eol == NULL)
+			eol = in->end;
+		while (in->p < eol && (*in->p == ' ' || *in->p == '\t'))
+			in->p++;
+		if (in->p < eol && *in->p != '#')
+			break;
+		in->p = eol + (eol < in->end);
+	}
+
+	for (i = 0; i < 3; i++) {
+		if (bulk_field(&in->p, eol, &f, &flen) != 0 ||
+		    (v[i] = bulk_number(f, flen)) == 0)
+			errx(1, "line %ju: invalid parameters",
+			    (uintmax_t)in->line);
+	}
+	p->iter = v[0];
+	p->c = v[1];
+	p->s = v[2];
+	p->rounds = 0;
+	p->width = 0;
+	for (i = 0; i < 3; i++) {
+		if (bulk_field(&in->p, eol, &f, &flen) != 0 ||
+		    (len = bulk_unhex(f, flen, buf)) < 0)
+			errx(1, "line %ju: invalid field %d",
+			    (uintmax_t)in->line, i + 4);
+		if (bulk_absorb(ctx, buf, len) != 0)
+			errx(1, "line %ju: mmcrypt_absorb failed",
+			    (uintmax_t)in->line);
+	}
+	if (bulk_field(&in->p, eol, &f, &flen) == 0)
+		errx(1, "line %ju: trailing fields", (uintmax_t)in->line);
+	in->p = eol + (eol < in->end);
+	memset(buf, 0, sizeof(buf));
+	return 0;
+}
+
+static void
+bulk_progress(uint64_t written, double start, double now, int final)
+{
+	double t = now - start;
+
+	fprintf(stderr, "%ju records, %.1f records/s, %.1f sec%s",
+	    (uintmax_t)written, t > 0 ? written / t : 0, t,
+	    final || !isatty(STDERR_FILENO) ? "\n" : "\r");
+}
+
+static void
+usage(const char *prog)
+{
+	fprintf(stderr,
+	    "usage: %s [-Pq] [-k keylen] [-m budget-MiB] [-p pepper]\n"
+	    "       [-W window] [-w workers] [-o output] input\n", prog);
+	exit(-1);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct mmcrypt_pool_config cfg;
+	struct mmcrypt_pool_stats st;
+	struct mmcrypt_ctx prefix, *ctx;
+	struct mmcrypt_params params;
+	struct mmcrypt_pool *pool;
+	struct bulk_input in;
+	struct bulk_slot *slots, *slot;
+	struct pollfd pfd;
+	struct stat sb;
+	const char *prog = basename(argv[0]);
+	const char *output = NULL, *pepper = NULL;
+	unsigned char key[BULK_KEY_MAX];
+	uint64_t submitted, written;
+	double start, now, report;
+	void *map, *arg;
+	FILE *out;
+	size_t keylen = 64, i;
+	uint32_t window = 0;
+	int quiet = 0, eof = 0;
+	int ch, fd, rv, status;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.pin = 1;
+	cfg.mem_max = (size_t)1024 << 20;
+	while ((ch = getopt(argc, argv, "PW:k:m:o:p:qw:")) != -1) {
+		switch (ch) {
+		case 'P':
+			cfg.pin = 0;
+			break;
+		case 'W':
+			window = strtoul(optarg, NULL, 0);
+			break;
+		case 'k':
+			keylen = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			cfg.mem_max = (size_t)strtoull(optarg, NULL, 0) << 20;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'p':
+			pepper = optarg;
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		case 'w':
+			cfg.workers = atoi(optarg);
+			break;
+		default:
+			usage(prog);
+		}
+	}
+	if (optind + 1 != argc || keylen == 0 || keylen > BULK_KEY_MAX ||
+	    cfg.workers < 0 || cfg.mem_max == 0)
+		usage(prog);
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0 || fstat(fd, &sb) != 0)
+		err(1, "%s", argv[optind]);
+	map = NULL;
+	if (sb.st_size != 0) {
+		map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED)
+			err(1, "mmap");
+		madvise(map, sb.st_size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+	in.p = map;
+	in.end = in.p + sb.st_size;
+	in.line = 0;
+
+	out = stdout;
+	if (output != NULL && (out = fopen(output, "w")) == NULL)
+		err(1, "%s", output);
+
+	pool = mmcrypt_pool_create(&cfg);
+	if (pool == NULL)
+		errx(1, "mmcrypt_pool_create failed");
+	if (window == 0) {
+		mmcrypt_pool_stats(pool, &st);
+		window = 4 * st.workers;
+	}
+	slots = calloc(window, sizeof(slots[0]));
+	if (slots == NULL)
+		err(1, "calloc");
+
+	mmcrypt_init(&prefix);
+	if (pepper != NULL &&
+	    bulk_absorb(&prefix, pepper, strlen(pepper)) != 0)
+		errx(1, "mmcrypt_absorb failed");
+
+	pfd.fd = mmcrypt_pool_fd(pool);
+	pfd.events = POLLIN;
+	submitted = written = 0;
+	start = report = bulk_now();
+	for (;;) {
+		/* Fill the window, slot of a record is its index modulo it. */
+		while (!eof && submitted - written < window) {
+			slot = &slots[submitted % window];
+			mmcrypt_ctx_clone(&slot->ctx, &prefix);
+			if (bulk_next(&in, &slot->ctx, &params) != 0) {
+				eof = 1;
+				break;
+			}
+			slot->line = in.line;
+			slot->done = 0;
+			rv = mmcrypt_pool_submit(pool, &slot->ctx, &params,
+			    NULL, slot);
+			if (rv == E2BIG)
+				errx(1, "line %ju: exceeds memory budget",
+				    (uintmax_t)slot->line);
+			if (rv != 0) {
+				errno = rv;
+				err(1, "line %ju", (uintmax_t)slot->line);
+			}
+			submitted++;
+		}
+		if (submitted == written)
+			break;
+
+		rv = poll(&pfd, 1, quiet ? -1 : 1000);
+		if (rv < 0 && errno != EINTR)
+			err(1, "poll");
+		while (mmcrypt_pool_reap(pool, &ctx, &arg, &status) == 0) {
+			slot = arg;
+			slot->status = status;
+			slot->done = 1;
+		}
+
+		while (written < submitted) {
+			slot = &slots[written % window];
+			if (!slot->done)
+				break;
+			if (slot->status != 0)
+				errx(1, "line %ju: mmcrypt_stretch failed: %s",
+				    (uintmax_t)slot->line,
+				    strerror(slot->status));
+			if (mmcrypt_squeeze_long(&slot->ctx, key, keylen) != 0)
+				errx(1, "line %ju: mmcrypt_squeeze failed",
+				    (uintmax_t)slot->line);
+			mmcrypt_destroy(&slot->ctx);
+			for (i = 0; i < keylen; i++)
+				fprintf(out, "%02X", key[i]);
+			fputc('\n', out);
+			written++;
+		}
+
+		now = bulk_now();
+		if (!quiet && now - report >= 1) {
+			bulk_progress(written, start, now, 0);
+			report = now;
+		}
+	}
+	memset(key, 0, sizeof(key));
+
+	if (fflush(out) != 0 || (out != stdout && fclose(out) != 0))
+		err(1, "%s", output != NULL ? output : "stdout");
+	if (!quiet)
+		bulk_progress(written, start, bulk_now(), 1);
+	mmcrypt_pool_destroy(pool);
+	mmcrypt_destroy(&prefix);
+	free(slots);
+	if (map != NULL)
+		munmap(map, sb.st_size);
+	return 0;
+}
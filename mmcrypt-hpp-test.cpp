@@ -0,0 +1,123 @@
+/*-
+ * Author: Gleb Kurtsou <gleb@FreeBSD.org>
+ *
+ * This software is hereby placed in the public domain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Build and known answer test of mmcrypt.hpp: keys through Context and
+ * Scratch must match the C interface and a vector of mmcrypt-kat.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <system_error>
+
+#include "mmcrypt.hpp"
+
+namespace {
+
+/* mmcrypt-kat vector ("password", 1, 1, 1), little-endian hosts. */
+const char kat_password_key[] =
+    "0912B636F13C20C5F0F1D8D2CDB6734B"
+    "A4FCF8D8B82C8ED76DB3BAC41B5815B0"
+    "A472E604AF7FF2FC0172DE3FE610FFDF"
+    "89A1F347F3FAA95C27182AD7533E8ABA";
+
+int failures;
+
+void
+check(bool ok, const char *what)
+{
+	if (ok)
+		return;
+	std::printf("FAIL: %s\n", what);
+	failures++;
+}
+
+void
+hex(char *out, std::span<const std::byte> in)
+{
+	for (std::byte b : in)
+		out += std::sprintf(out, "%02X", static_cast<unsigned>(b));
+}
+
+int
+c_key(const mmcrypt::Params &p, std::uint8_t *key, std::size_t keylen,
+    const char *label)
+{
+	struct mmcrypt_ctx ctx;
+	int rv;
+
+	mmcrypt_init(&ctx);
+	rv = mmcrypt_absorb(&ctx, "password", 8);
+	rv |= mmcrypt_stretch_params(&ctx, &p);
+	if (label != nullptr)
+		rv |= mmcrypt_derive(&ctx, label, key, keylen);
+	else
+		rv |= mmcrypt_squeeze(&ctx, key, keylen);
+	mmcrypt_destroy(&ctx);
+	return rv;
+}
+
+} // namespace
+
+int
+main(int argc, char **argv)
+{
+	const mmcrypt::Params p = { .iter = 1, .c = 1, .s = 1 };
+	mmcrypt::Params bad = p;
+	mmcrypt::Context ctx, snapshot;
+	mmcrypt::Scratch scratch;
+	std::byte key[64], key2[64], sub[32];
+	std::uint8_t ckey[64], csub[32];
+	char keyhex[sizeof(key) * 2 + 1];
+	std::error_code ec;
+
+	(void)argc;
+	check(!ctx.absorb("password"), "absorb");
+	snapshot = ctx.clone();
+	ec = ctx.stretch(p, scratch);
+	check(!ec && scratch.size() >= mmcrypt_memsize(&p), "stretch scratch");
+	check(!ctx.squeeze(key), "squeeze");
+	hex(keyhex, key);
+	check(std::strcmp(keyhex, kat_password_key) == 0, "known answer");
+	check(c_key(p, ckey, sizeof(ckey), nullptr) == 0 &&
+	    std::memcmp(key, ckey, sizeof(key)) == 0, "C interface key");
+
+	/* Snapshot and move, tables allocated by the C library. */
+	ctx.restore(snapshot);
+	mmcrypt::Context moved(std::move(ctx));
+	check(!moved.stretch(p) && !moved.squeeze(key2) &&
+	    std::memcmp(key, key2, sizeof(key)) == 0, "restore, move");
+
+	ctx = snapshot.clone();
+	check(!ctx.stretch(p, scratch) && !ctx.derive("subkey", sub) &&
+	    c_key(p, csub, sizeof(csub), "subkey") == 0 &&
+	    std::memcmp(sub, csub, sizeof(sub)) == 0, "derive");
+	check(ctx.derive("", sub) == mmcrypt::errc::failed, "empty label");
+
+	bad.c = 0;
+	check(ctx.stretch(bad) == mmcrypt::errc::invalid_params &&
+	    ctx.stretch(bad, scratch) == mmcrypt::errc::invalid_params,
+	    "invalid parameters");
+	check(make_error_code(mmcrypt::errc::no_memory).category().name() ==
+	    std::string_view("mmcrypt"), "error category");
+
+	std::printf("%s: %s\n", argv[0], failures == 0 ? "passed" : "FAILED");
+	return failures == 0 ? 0 : 1;
+}
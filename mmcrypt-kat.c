@@ -0,0 +1,1351 @@
+/*-
+ * Author: Gleb Kurtsou <gleb@FreeBSD.org>
+ *
+ * This software is hereby placed in the public domain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Known answer and differential tests.
+ *
+ * Frozen mmcrypt vectors are checked first.  Then the Keccak backend
+ * linked in (permutation, fast absorb and extract paths, duplex and
+ * sponge) and mmcrypt_stretch() are compared against a straightforward
+ * implementation contained in this file: byte oriented Keccak-f[1600]
+ * and mmcrypt stretch written after the README pseudo-code.  -r runs
+ * additional randomized differential rounds.
+ *
+ * Every Keccak backend is linked into its own mmcrypt-kat-<backend>
+ * binary, 'make check' runs all of them.
+ *
+ * -t runs only concurrent stretches and streaming absorbs from several
+ * threads and through mmcrypt_pool and compares them with single threaded
+ * results, 'make tsan' runs it under ThreadSanitizer.
+ */
+
+#if defined(__linux__)
+#include <endian.h>
+#elif defined(__FreeBSD__)
+#include <sys/endian.h>
+#endif
+#include <err.h>
+#include <errno.h>
+#include <poll.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mmcrypt.h"
+#include "mmcrypt-numa.h"
+#include "mmcrypt-pool.h"
+#include "mmcrypt-tree.h"
+#include "KeccakF-1600-interface.h"
+#include "KeccakNISTInterface.h"
+
+#define KAT_INPUTS_MAX		4
+#define KAT_STRESS_C_MAX	6
+#define KAT_STRESS_STREAM	4096
+
+struct kat_vector {
+	const char *inputs[KAT_INPUTS_MAX];
+	uint32_t iter, c, s;
+	const char *key;
+};
+
+/*
+ * First 64 bytes squeezed after absorbing inputs and stretching.
+ * GF(2^512) multiplication works on host order words, vectors are for
+ * little-endian hosts.
+ */
+static const struct kat_vector kat_vectors[] = {
+	{ { NULL }, 1, 1, 1,
+	    "EA45AA6E7EC2B5D70877BEE723DB5E70"
+	    "28F12C29E2D074D7316D7B431D134D5C"
+	    "D4EA8B70549CBFADADF4E7EECA45F1EE"
+	    "F705CFA2D62DA269710953B7830B5BFC" },
+	{ { "password" }, 1, 1, 1,
+	    "0912B636F13C20C5F0F1D8D2CDB6734B"
+	    "A4FCF8D8B82C8ED76DB3BAC41B5815B0"
+	    "A472E604AF7FF2FC0172DE3FE610FFDF"
+	    "89A1F347F3FAA95C27182AD7533E8ABA" },
+	{ { "" }, 1, 2, 3,
+	    "F5F967C3FF6C685BB2C568F338EE8550"
+	    "0742B4486C93840B8D91BCCDC34FEF46"
+	    "1579A0A76E5D71C3B01DF9DA49EE9FF6"
+	    "0287006A311DFF8CCBC6ECE708E8A6AB" },
+	{ { "pepper", "salt", "tag", "password" }, 1, 7, 337,
+	    "ABF2919CC07EEAE253B4F92F93359885"
+	    "84AFAC851EA98F38876F902878793C05"
+	    "86624CA594B16EA2FA03C0D774D22A54"
+	    "C4F5485A84B607580AC510DD98EACD86" },
+	{ { "0123456789abcdef0123456789abcdef0123456789abcdef"
+	    "0123456789abcdef012345" }, 2, 3, 5,
+	    "2CF07601215103BC2AF8F9CB847BA798"
+	    "5DAF786759FEA9A83EB038D08144D581"
+	    "5EC62C709B87BF128105D73D0680445C"
+	    "0082A7580EBED25389863D483DF4671F" },
+	{ { "salt", "password" }, 3, 4, 17,
+	    "ACDBA86B07F397C0DD337A18FF18A38F"
+	    "35AA548AD34AAD71FF8DC00F1CDD0A06"
+	    "30819B9B4AD9F70C885C8B1466192B85"
+	    "ECA24CE20C7FBF6DB52B8349F070A0A2" },
+	{ { "a", "b", "c", "d" }, 2, 6, 17,
+	    "91A572ED647CF4B3B3591410E96AA0AF"
+	    "E211DC16C915DADF16F913F97BE3BC87"
+	    "01EC60F88C1BD8F39ADBE3A7E5CC40D3"
+	    "19ED9411A5BAB7DE95B48DDAA3AC822E" },
+	{ { "password" }, 1, 8, 64,
+	    "EC9FBBC1137D4627FABF5D4F653ACE9D"
+	    "727B7B1A87A5D2FC20B69C34DC4475A8"
+	    "8733501BE97464FFA764EAE2CFCC12A2"
+	    "04187E5E4B1C2DDF6DCCB95EC64A6472" },
+};
+
+#define KAT_VECTORS		(sizeof(kat_vectors) / sizeof(kat_vectors[0]))
+
+static int kat_verbose;
+static int kat_failures;
+
+/* Reference Keccak-f[1600]. */
+
+static const uint64_t kat_rc[24] = {
+	0x0000000000000001ULL, 0x0000000000008082ULL,
+	0x800000000000808AULL, 0x8000000080008000ULL,
+	0x000000000000808BULL, 0x0000000080000001ULL,
+	0x8000000080008081ULL, 0x8000000000008009ULL,
+	0x000000000000008AULL, 0x0000000000000088ULL,
+	0x0000000080008009ULL, 0x000000008000000AULL,
+	0x000000008000808BULL, 0x800000000000008BULL,
+	0x8000000000008089ULL, 0x8000000000008003ULL,
+	0x8000000000008002ULL, 0x8000000000000080ULL,
+	0x000000000000800AULL, 0x800000008000000AULL,
+	0x8000000080008081ULL, 0x8000000000008080ULL,
+	0x0000000080000001ULL, 0x8000000080008008ULL,
+};
+
+static const unsigned int kat_rho[25] = {
+	 0,  1, 62, 28, 27,
+	36, 44,  6, 55, 20,
+	 3, 10, 43, 25, 39,
+	41, 45, 15, 21,  8,
+	18,  2, 61, 56, 14,
+};
+
+#define KAT_ROL64(a, n)	((n) == 0 ? (a) : ((a) << (n)) | ((a) >> (64 - (n))))
+
+/* Keccak-p[1600, nr], the last nr rounds of Keccak-f[1600]. */
+static void
+kat_keccakp(uint8_t *state, int nr)
+{
+	uint64_t a[25], b[25], c[5], d;
+	int i, r, x, y;
+
+	for (i = 0; i < 25; i++)
+		for (x = 0, a[i] = 0; x < 8; x++)
+			a[i] |= (uint64_t)state[i * 8 + x] << (8 * x);
+	for (r = 24 - nr; r < 24; r++) {
+		for (x = 0; x < 5; x++)
+			c[x] = a[x] ^ a[x + 5] ^ a[x + 10] ^ a[x + 15] ^
+			    a[x + 20];
+		for (x = 0; x < 5; x++) {
+			d = c[(x + 4) % 5] ^ KAT_ROL64(c[(x + 1) % 5], 1);
+			for (y = 0; y < 25; y += 5)
+				a[x + y] ^= d;
+		}
+		for (x = 0; x < 5; x++)
+			for (y = 0; y < 5; y++)
+				b[y + 5 * ((2 * x + 3 * y) % 5)] =
+				    KAT_ROL64(a[x + 5 * y], kat_rho[x + 5 * y]);
+		for (y = 0; y < 25; y += 5)
+			for (x = 0; x < 5; x++)
+				a[x + y] = b[x + y] ^
+				    (~b[(x + 1) % 5 + y] & b[(x + 2) % 5 + y]);
+		a[0] ^= kat_rc[r];
+	}
+	for (i = 0; i < 25; i++)
+		for (x = 0; x < 8; x++)
+			state[i * 8 + x] = a[i] >> (8 * x);
+}
+
+static void
+kat_keccakf(uint8_t *state)
+{
+	kat_keccakp(state, 24);
+}
+
+/*
+ * Reference duplex on Keccak-p[1600, nr], rate in bits, input of arbitrary
+ * bit length.
+ */
+static void
+kat_duplex_rounds(uint8_t *state, unsigned int rate, const uint8_t *in,
+    unsigned int inbits, uint8_t *out, unsigned int outbits, int nr)
+{
+	uint8_t block[200];
+	unsigned int i;
+
+	memset(block, 0, sizeof(block));
+	if (inbits != 0)
+		memcpy(block, in, (inbits + 7) / 8);
+	block[inbits / 8] |= 1 << (inbits % 8);
+	block[(rate - 1) / 8] |= 1 << ((rate - 1) % 8);
+	for (i = 0; i < (rate + 7) / 8; i++)
+		state[i] ^= block[i];
+	kat_keccakp(state, nr);
+	if (outbits == 0)
+		return;
+	memcpy(out, state, (outbits + 7) / 8);
+	if (outbits % 8 != 0)
+		out[outbits / 8] &= (1 << (outbits % 8)) - 1;
+}
+
+static void
+kat_duplex(uint8_t *state, unsigned int rate, const uint8_t *in,
+    unsigned int inbits, uint8_t *out, unsigned int outbits)
+{
+	kat_duplex_rounds(state, rate, in, inbits, out, outbits, 24);
+}
+
+/* Reference sponge over whole bytes. */
+static void
+kat_sponge(unsigned int rate, const uint8_t *in, size_t inlen,
+    uint8_t *out, size_t outlen)
+{
+	uint8_t state[200];
+	size_t i, n;
+
+	memset(state, 0, sizeof(state));
+	for (; inlen >= rate / 8; in += rate / 8, inlen -= rate / 8) {
+		for (i = 0; i < rate / 8; i++)
+			state[i] ^= in[i];
+		kat_keccakf(state);
+	}
+	for (i = 0; i < inlen; i++)
+		state[i] ^= in[i];
+	state[inlen] ^= 0x01;
+	state[rate / 8 - 1] ^= 0x80;
+	kat_keccakf(state);
+	for (;;) {
+		n = outlen < rate / 8 ? outlen : rate / 8;
+		memcpy(out, state, n);
+		out += n;
+		outlen -= n;
+		if (outlen == 0)
+			break;
+		kat_keccakf(state);
+	}
+}
+
+/* Reference sponge over whole bytes followed by suffix bits. */
+static void
+kat_sponge_suffix(unsigned int rate, const uint8_t *in, size_t inlen,
+    unsigned int suffix, unsigned int suffixbits, uint8_t *out, size_t outlen)
+{
+	uint8_t state[200], *msg;
+	size_t len, off, i;
+	unsigned int tail;
+
+	len = (inlen * 8 + suffixbits + 2 + rate - 1) / rate * (rate / 8);
+	msg = calloc(1, len + 1);
+	if (msg == NULL)
+		err(1, "calloc");
+	memcpy(msg, in, inlen);
+	tail = suffix | 1 << suffixbits;
+	msg[inlen] |= tail;
+	msg[inlen + 1] |= tail >> 8;
+	msg[len - 1] |= 0x80;
+	memset(state, 0, sizeof(state));
+	for (off = 0; off < len; off += rate / 8) {
+		for (i = 0; i < rate / 8; i++)
+			state[i] ^= msg[off + i];
+		kat_keccakf(state);
+	}
+	memcpy(out, state, outlen);
+	free(msg);
+}
+
+/* Reference KangarooTwelve style tree hash of mmcrypt-tree.h. */
+static void
+kat_tree(const uint8_t *in, size_t len, uint8_t *digest)
+{
+	uint8_t *node, *p;
+	size_t leaves, i, l, x;
+	int n;
+
+	if (len <= MMCRYPT_TREE_CHUNK) {
+		kat_sponge_suffix(576, in, len, 0x03, 2, digest, 64);
+		return;
+	}
+	leaves = (len - 1) / MMCRYPT_TREE_CHUNK;
+	node = calloc(1, MMCRYPT_TREE_CHUNK + 8 + leaves * 64 + 16);
+	if (node == NULL)
+		err(1, "calloc");
+	memcpy(node, in, MMCRYPT_TREE_CHUNK);
+	p = node + MMCRYPT_TREE_CHUNK;
+	*p = 0x03;
+	p += 8;
+	for (i = 1; i <= leaves; i++, p += 64) {
+		l = len - i * MMCRYPT_TREE_CHUNK;
+		if (l > MMCRYPT_TREE_CHUNK)
+			l = MMCRYPT_TREE_CHUNK;
+		kat_sponge_suffix(576, in + i * MMCRYPT_TREE_CHUNK, l, 0x03, 3,
+		    p, 64);
+	}
+	for (x = leaves, n = 0; x != 0; x >>= 8)
+		n++;
+	for (x = leaves, i = n; i > 0; x >>= 8)
+		p[--i] = x & 0xff;
+	p += n;
+	*p++ = n;
+	*p++ = 0xff;
+	*p++ = 0xff;
+	kat_sponge_suffix(576, node, p - node, 0x02, 2, digest, 64);
+	free(node);
+}
+
+/* Reference mmcrypt, duplex rate 576 bits. */
+
+#define KAT_RATE		576
+#define KAT_ROW			64
+
+struct kat_ctx {
+	uint8_t sm[200];
+};
+
+static uint64_t
+kat_be64(const uint8_t *p)
+{
+	uint64_t v;
+	int i;
+
+	for (i = 0, v = 0; i < 8; i++)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+static void
+kat_put_be64(uint8_t *p, uint64_t v)
+{
+	int i;
+
+	for (i = 7; i >= 0; i--, v >>= 8)
+		p[i] = v;
+}
+
+static uint64_t
+kat_gfpol(uint32_t c)
+{
+	static const int taps[32][5] = {
+		{ 0 }, { 1 }, { 1 }, { 1, 4, 5 },
+		{ 2, 4, 5, 6, 7 }, { 1, 2, 5, 6, 7 }, { 2, 6, 8, 9, 10 },
+		{ 1, 3, 4, 5, 11 }, { 2, 9, 12, 13, 14 }, { 1, 4, 7, 8, 10 },
+		{ 1, 10, 14, 16, 18 }, { 2, 4, 9, 14, 21 },
+		{ 3, 6, 7, 16, 23 }, { 1, 6, 15, 17, 24 },
+		{ 5, 11, 21, 24, 27 }, { 11, 12, 24, 28, 29 },
+		{ 1, 3, 12, 17, 30 }, { 4, 7, 14, 20, 31 },
+		{ 6, 17, 25, 26, 28 }, { 6, 9, 11, 20, 36 },
+		{ 6, 7, 18, 28, 36 }, { 1, 8, 14, 24, 27 },
+		{ 5, 16, 25, 40, 43 }, { 21, 23, 24, 40, 44 },
+		{ 5, 12, 27, 29, 43 }, { 5, 6, 16, 21, 36 },
+		{ 1, 2, 16, 25, 50 }, { 9, 10, 23, 24, 34 },
+		{ 5, 20, 28, 38, 45 }, { 23, 32, 37, 54, 55 },
+		{ 12, 13, 19, 31, 48 }, { 2, 9, 16, 18, 48 },
+	};
+	uint64_t pol;
+	int i;
+
+	if (c == 0)
+		return 0;
+	for (i = 0, pol = 1; i < 5 && taps[c][i] != 0; i++)
+		pol |= 1ULL << taps[c][i];
+	return pol;
+}
+
+/*
+ * 512-bit row as seen by the GF(2^512) multiplication: 8 native 64-bit
+ * words, most significant first.
+ */
+static void
+kat_gfmul_512(uint8_t *row)
+{
+	uint64_t w[8];
+	uint64_t msb;
+	int i;
+
+	memcpy(w, row, sizeof(w));
+	msb = w[0] >> 63;
+	for (i = 0; i < 7; i++)
+		w[i] = (w[i] << 1) | (w[i + 1] >> 63);
+	w[7] = (w[7] << 1) ^ (msb ? 0x125 : 0);
+	memcpy(row, w, sizeof(w));
+}
+
+/*
+ * rounds 0 or 24: Keccak-f fill, 12: reduced-round fill.  width 0 or 64:
+ * 512-bit rows, otherwise rows of width bytes, KAT_ROW byte blocks each.
+ */
+static void
+kat_stretch(struct kat_ctx *ctx, uint32_t iter, uint32_t c, uint32_t s,
+    uint32_t rounds, uint32_t width)
+{
+	uint8_t s1[200], s2[200], st[200];
+	uint8_t feedback[KAT_ROW], x[KAT_ROW], tmp[KAT_ROW];
+	uint8_t *t1, *t2, *r1, *r2, *y1, *y2;
+	uint64_t *k, k0, pol;
+	uint32_t n, i, j, w, lg, ka, kb, count, row, blk;
+	int b, nr;
+
+	if (rounds == 24)
+		rounds = 0;
+	nr = rounds != 0 ? rounds : 24;
+	if (width == KAT_ROW)
+		width = 0;
+	row = width != 0 ? width : KAT_ROW;
+	n = 1U << c;
+	pol = kat_gfpol(c);
+	k = calloc(s, sizeof(k[0]));
+	t1 = calloc((size_t)n * s, row);
+	t2 = calloc((size_t)n * s, row);
+	if (k == NULL || t1 == NULL || t2 == NULL)
+		err(1, "calloc");
+	memset(s1, 0, sizeof(s1));
+	memset(s2, 0, sizeof(s2));
+	memset(feedback, 0, sizeof(feedback));
+	memset(x, 0, sizeof(x));
+	kat_put_be64(x + 0, MMCRYPT_FEEDBACK_RATE);
+	kat_put_be64(x + 8, iter);
+	kat_put_be64(x + 16, c);
+	kat_put_be64(x + 24, s);
+	kat_put_be64(x + 32, rounds);
+	kat_put_be64(x + 40, width);
+	kat_duplex(ctx->sm, KAT_RATE, x, 512, NULL, 0);
+	for (; iter > 0; iter--) {
+		kat_duplex(ctx->sm, KAT_RATE, NULL, 0, x, 512);
+		kat_duplex_rounds(s1, KAT_RATE, x, 512, NULL, 0, nr);
+		kat_duplex(ctx->sm, KAT_RATE, NULL, 0, x, 512);
+		kat_duplex_rounds(s2, KAT_RATE, x, 512, NULL, 0, nr);
+		for (i = 0; i < s; i++) {
+			kat_duplex(ctx->sm, KAT_RATE, NULL, 0, x, 64);
+			k[i] = (kat_be64(x) >> (64 - 2 * c)) | 1;
+		}
+		/* T[[i]] = T[i / s][i % s], rows are stored by [[i]]. */
+		for (blk = 0; blk < row; blk += KAT_ROW) {
+			kat_duplex_rounds(s1, KAT_RATE, NULL, 0, t1 + blk, 512,
+			    nr);
+			kat_duplex_rounds(s2, KAT_RATE, NULL, 0, t2 + blk, 512,
+			    nr);
+		}
+		for (i = 1; i < n * s; i++) {
+			for (lg = 0; (2U << lg) <= i; lg++)
+				;
+			/* Source rows from the last 64 bits of row i - 1. */
+			w = kat_be64(t2 + (size_t)i * row - 8);
+			ka = (w & ((1U << lg) - 1)) + i - (1U << lg);
+			w = kat_be64(t1 + (size_t)i * row - 8);
+			kb = (w & ((1U << lg) - 1)) + i - (1U << lg);
+			for (blk = 0; blk < row; blk += KAT_ROW) {
+				kat_duplex_rounds(s1, KAT_RATE,
+				    t2 + (size_t)ka * row + blk, 512,
+				    t1 + (size_t)i * row + blk, 512, nr);
+				kat_duplex_rounds(s2, KAT_RATE,
+				    t1 + (size_t)kb * row + blk, 512,
+				    t2 + (size_t)i * row + blk, 512, nr);
+			}
+		}
+		count = 0;
+		k0 = k[0];
+		do {
+			for (i = 0; i < s; i++) {
+				/* k[i] = k[i] * alpha in GF(2^(2c)) */
+				k[i] <<= 1;
+				if (k[i] & (1ULL << (2 * c)))
+					k[i] ^= pol;
+				k[i] &= (1ULL << (2 * c)) - 1;
+				ka = k[i] >> c;
+				kb = k[i] & (n - 1);
+				r1 = t1 + ((size_t)ka * s + i) * row;
+				r2 = t2 + ((size_t)kb * s + i) * row;
+				y1 = t1 + ((size_t)ka * s + (i + 1) % s) * row;
+				y2 = t2 + ((size_t)kb * s + (i + 1) % s) * row;
+				/* Feedback takes the XOR of all blocks. */
+				memset(x, 0, sizeof(x));
+				for (j = 0; j < row; j++)
+					x[j % KAT_ROW] ^= r1[j] ^ r2[j];
+				if ((kat_be64(r1) >> (64 - c)) !=
+				    (kat_be64(r2) >> (64 - c)))
+					for (j = 0; j < KAT_ROW; j++)
+						feedback[j] ^= x[j];
+				kat_gfmul_512(feedback);
+				for (blk = 0; blk < row && (feedback[0] & 0x80);
+				    blk += KAT_ROW) {
+					for (j = 0; j < KAT_ROW; j++)
+						tmp[j] = r1[blk + j] ^
+						    r2[blk + j];
+					kat_gfmul_512(tmp);
+					/* y1 ^= tmp; y2 ^= tmp; swap */
+					for (j = 0; j < KAT_ROW; j++) {
+						b = y1[blk + j] ^ tmp[j];
+						y1[blk + j] = y2[blk + j] ^
+						    tmp[j];
+						y2[blk + j] = b;
+					}
+				}
+				if (++count == MMCRYPT_FEEDBACK_RATE) {
+					count = 0;
+					kat_duplex(ctx->sm, KAT_RATE,
+					    feedback, 512, feedback, 512);
+				}
+			}
+		} while (k[0] != k0);
+		kat_duplex(ctx->sm, KAT_RATE, feedback, 512, NULL, 0);
+		memcpy(st, s1, sizeof(st));
+		memcpy(s1, s2, sizeof(s1));
+		memcpy(s2, st, sizeof(s2));
+	}
+	free(k);
+	free(t1);
+	free(t2);
+}
+
+/* Helpers. */
+
+static uint64_t kat_rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t
+kat_rng(void)
+{
+	kat_rng_state ^= kat_rng_state >> 12;
+	kat_rng_state ^= kat_rng_state << 25;
+	kat_rng_state ^= kat_rng_state >> 27;
+	return kat_rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static uint32_t
+kat_rand(uint32_t n)
+{
+	return kat_rng() % n;
+}
+
+static void
+kat_fill(uint8_t *p, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		p[i] = kat_rng();
+}
+
+static void
+kat_hex(char *hex, const uint8_t *p, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		sprintf(hex + i * 2, "%02X", p[i]);
+}
+
+static void
+kat_check(int ok, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void
+kat_check(int ok, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (ok && !kat_verbose)
+		return;
+	va_start(ap, fmt);
+	printf("%s: ", ok ? "ok" : "FAIL");
+	vprintf(fmt, ap);
+	printf("\n");
+	va_end(ap);
+	if (!ok)
+		kat_failures++;
+}
+
+/* Tests. */
+
+static int
+kat_vector_absorb(const struct kat_vector *v, struct mmcrypt_ctx *ctx)
+{
+	int j, rv;
+
+	mmcrypt_init(ctx);
+	rv = 0;
+	for (j = 0; j < KAT_INPUTS_MAX && v->inputs[j] != NULL; j++)
+		rv |= mmcrypt_absorb(ctx, v->inputs[j], strlen(v->inputs[j]));
+	return rv;
+}
+
+static int
+kat_vector_key(const struct kat_vector *v, uint8_t *key, size_t keylen)
+{
+	struct mmcrypt_ctx ctx;
+	int rv;
+
+	rv = kat_vector_absorb(v, &ctx);
+	rv |= mmcrypt_stretch(&ctx, v->iter, v->c, v->s);
+	rv |= mmcrypt_squeeze(&ctx, key, keylen);
+	mmcrypt_destroy(&ctx);
+	return rv;
+}
+
+static void
+kat_test_vectors(void)
+{
+	const struct kat_vector *v;
+	uint8_t key[64];
+	char hex[sizeof(key) * 2 + 1];
+	size_t i;
+	int rv;
+
+	for (i = 0; i < KAT_VECTORS; i++) {
+		v = &kat_vectors[i];
+		rv = kat_vector_key(v, key, sizeof(key));
+		kat_hex(hex, key, sizeof(key));
+		kat_check(rv == 0 && strcmp(hex, v->key) == 0,
+		    "vector %zu mmcrypt(%u, %u, %u) = %s", i,
+		    v->iter, v->c, v->s, hex);
+	}
+}
+
+typedef void kat_absorb_fn(unsigned char *state, const unsigned char *data);
+
+static void
+kat_test_absorb(const char *name, kat_absorb_fn *fn, unsigned int lanes)
+{
+	ALIGN unsigned char state[200];
+	ALIGN unsigned char data[200];
+	ALIGN unsigned char out[200];
+	uint8_t ref[200];
+	int i, j;
+
+	KeccakInitializeState(state);
+	memset(ref, 0, sizeof(ref));
+	for (i = 0; i < 4; i++) {
+		kat_fill(data, lanes * 8);
+		if (fn != NULL)
+			fn(state, data);
+		else
+			KeccakAbsorb(state, data, lanes);
+		for (j = 0; j < (int)lanes * 8; j++)
+			ref[j] ^= data[j];
+		kat_keccakf(ref);
+	}
+	KeccakExtract(state, out, 25);
+	kat_check(memcmp(out, ref, sizeof(ref)) == 0, "%s %u lanes",
+	    name, lanes);
+}
+
+static void
+kat_test_keccak(void)
+{
+	ALIGN unsigned char state[200];
+	ALIGN unsigned char out[200];
+	uint8_t ref[200];
+	unsigned int i, lanes, nr;
+
+	KeccakInitialize();
+	for (lanes = 1; lanes <= 25; lanes++)
+		kat_test_absorb("KeccakAbsorb", NULL, lanes);
+#ifdef ProvideFast576
+	kat_test_absorb("KeccakAbsorb576bits", KeccakAbsorb576bits, 9);
+#endif
+#ifdef ProvideFast832
+	kat_test_absorb("KeccakAbsorb832bits", KeccakAbsorb832bits, 13);
+#endif
+#ifdef ProvideFast1024
+	kat_test_absorb("KeccakAbsorb1024bits", KeccakAbsorb1024bits, 16);
+#endif
+#ifdef ProvideFast1088
+	kat_test_absorb("KeccakAbsorb1088bits", KeccakAbsorb1088bits, 17);
+#endif
+#ifdef ProvideFast1152
+	kat_test_absorb("KeccakAbsorb1152bits", KeccakAbsorb1152bits, 18);
+#endif
+#ifdef ProvideFast1344
+	kat_test_absorb("KeccakAbsorb1344bits", KeccakAbsorb1344bits, 21);
+#endif
+
+	/* Permutation of a random state, twice. */
+	KeccakInitializeState(state);
+	kat_fill(out, sizeof(out));
+	KeccakAbsorb(state, out, 25);
+	memcpy(ref, out, sizeof(ref));
+	kat_keccakf(ref);
+	KeccakPermutation(state);
+	kat_keccakf(ref);
+	KeccakPermutation(state);
+	kat_keccakf(ref);
+	KeccakExtract(state, out, 25);
+	kat_check(memcmp(out, ref, sizeof(ref)) == 0, "KeccakPermutation");
+
+	/* Reduced and full rounds on a random state, twice. */
+	for (nr = 12; nr <= 24; nr += 12) {
+		KeccakInitializeState(state);
+		memset(ref, 0, sizeof(ref));
+		for (lanes = 9; lanes <= 25; lanes += 16) {
+			kat_fill(out, lanes * 8);
+			KeccakAbsorbRounds(state, out, lanes, nr);
+			for (i = 0; i < lanes * 8; i++)
+				ref[i] ^= out[i];
+			kat_keccakp(ref, nr);
+		}
+		KeccakExtract(state, out, 25);
+		kat_check(memcmp(out, ref, sizeof(ref)) == 0,
+		    "KeccakAbsorbRounds %u rounds", nr);
+	}
+#ifdef ProvideFast1024
+	memset(out, 0, sizeof(out));
+	KeccakExtract1024bits(state, out);
+	kat_check(memcmp(out, ref, 128) == 0 &&
+	    memcmp(out + 128, ref + 128, 72) != 0, "KeccakExtract1024bits");
+#endif
+}
+
+static void
+kat_test_duplex(int rounds)
+{
+	duplexState ds;
+	uint8_t ref[200];
+	uint8_t in[200], out[200], refout[200];
+	static const unsigned int rates[] = { 576, 1024, 1088, 1344, 1600 };
+	unsigned int rate, inbits, outbits;
+	int i, r, rv;
+
+	for (r = 0; r < (int)(sizeof(rates) / sizeof(rates[0])); r++) {
+		rate = rates[r];
+		rv = InitDuplex(&ds, rate, 1600 - rate);
+		memset(ref, 0, sizeof(ref));
+		for (i = 0; i < rounds && rv == 0; i++) {
+			inbits = kat_rand(rate - 1);
+			outbits = kat_rand(rate + 1);
+			memset(in, 0, sizeof(in));
+			kat_fill(in, (inbits + 7) / 8);
+			if (inbits % 8 != 0)
+				in[inbits / 8] &= (1 << (inbits % 8)) - 1;
+			rv = Duplexing(&ds, in, inbits, out, outbits);
+			kat_duplex(ref, rate, in, inbits, refout, outbits);
+			if (memcmp(out, refout, (outbits + 7) / 8) != 0)
+				rv = -1;
+		}
+		kat_check(rv == 0, "Duplexing rate %u, %d rounds", rate,
+		    rounds);
+	}
+}
+
+static void
+kat_test_sponge(int rounds)
+{
+	static const unsigned int rates[] = {
+		576, 640, 832, 1024, 1088, 1152, 1344, 1536
+	};
+	spongeState ss;
+	uint8_t *in, out[2048], ref[2048];
+	size_t inlen, outlen, off, n;
+	unsigned int rate;
+	int i, r, rv;
+
+	in = malloc(4096);
+	if (in == NULL)
+		err(1, "malloc");
+	for (r = 0; r < (int)(sizeof(rates) / sizeof(rates[0])); r++) {
+		rate = rates[r];
+		for (i = 0, rv = 0; i < rounds && rv == 0; i++) {
+			inlen = kat_rand(4096);
+			outlen = kat_rand(sizeof(out)) + 1;
+			kat_fill(in, inlen);
+			rv = InitSponge(&ss, rate, 1600 - rate);
+			/* Feed the sponge in random sized chunks. */
+			for (off = 0; off < inlen && rv == 0; off += n) {
+				n = kat_rand(inlen - off) + 1;
+				rv = Absorb(&ss, in + off, n * 8);
+			}
+			for (off = 0; off < outlen && rv == 0; off += n) {
+				n = kat_rand(outlen - off) + 1;
+				rv = Squeeze(&ss, out + off, n * 8);
+			}
+			kat_sponge(rate, in, inlen, ref, outlen);
+			if (rv == 0 && memcmp(out, ref, outlen) != 0)
+				rv = -1;
+		}
+		kat_check(rv == 0, "Sponge rate %u, %d rounds", rate, rounds);
+	}
+	free(in);
+}
+
+#define KAT_MANY_MAX		11
+#define KAT_MANY_LEN		600
+
+static void
+kat_test_hash_many(int rounds)
+{
+	/* Keccak-256 of the empty message. */
+	static const char empty256[] =
+	    "C5D2460186F7233C927E7DB2DCC703C0E500B653CA82273B7BFAD8045D85A470";
+	static const int hashlens[] = { 224, 256, 384, 512 };
+	const BitSequence *data[KAT_MANY_MAX];
+	BitSequence *hashval[KAT_MANY_MAX];
+	DataLength bitlen[KAT_MANY_MAX];
+	uint8_t *in, out[KAT_MANY_MAX][64], ref[64];
+	char hex[sizeof(ref) * 2 + 1];
+	unsigned int n;
+	int h, i, j, rv;
+
+	rv = Hash(256, (const BitSequence *)"", 0, ref);
+	kat_hex(hex, ref, 32);
+	kat_check(rv == SUCCESS && strcmp(hex, empty256) == 0,
+	    "Keccak-256('') = %s", hex);
+
+	in = malloc(KAT_MANY_MAX * KAT_MANY_LEN);
+	if (in == NULL)
+		err(1, "malloc");
+	for (h = 0; h < (int)(sizeof(hashlens) / sizeof(hashlens[0])); h++) {
+		for (i = 0, rv = 0; i < rounds && rv == 0; i++) {
+			/* Ragged bit lengths, n not a multiple of SIMD ways. */
+			n = kat_rand(KAT_MANY_MAX + 1);
+			for (j = 0; j < (int)n; j++) {
+				data[j] = in + j * KAT_MANY_LEN;
+				bitlen[j] = kat_rand(KAT_MANY_LEN * 8 + 1);
+				hashval[j] = out[j];
+				kat_fill(in + j * KAT_MANY_LEN, KAT_MANY_LEN);
+			}
+			rv = HashMany(hashlens[h], data, bitlen, hashval, n);
+			for (j = 0; j < (int)n && rv == 0; j++) {
+				rv = Hash(hashlens[h], data[j], bitlen[j], ref);
+				if (rv == 0 && memcmp(out[j], ref,
+				    hashlens[h] / 8) != 0)
+					rv = -1;
+			}
+		}
+		kat_check(rv == 0, "HashMany %d, %d rounds", hashlens[h],
+		    rounds);
+	}
+	free(in);
+}
+
+static void
+kat_test_stretch(uint32_t iter, uint32_t c, uint32_t s, uint32_t rounds,
+    uint32_t width, enum mmcrypt_layout layout)
+{
+	const struct mmcrypt_params p = { .iter = iter, .c = c, .s = s,
+	    .rounds = rounds, .width = width };
+	struct mmcrypt_ctx ctx;
+	struct kat_ctx ref;
+	uint8_t in[71], key[64], refkey[64];
+	char hex[sizeof(key) * 2 + 1];
+	size_t inlen;
+	int i, n, rv;
+
+	mmcrypt_init(&ctx);
+	mmcrypt_set_layout(&ctx, layout);
+	memset(&ref, 0, sizeof(ref));
+	rv = mmcrypt_table_node(&ctx) != -1;
+	n = kat_rand(4);
+	for (i = 0; i < n; i++) {
+		inlen = kat_rand(sizeof(in) + 1);
+		kat_fill(in, inlen);
+		rv |= mmcrypt_absorb(&ctx, in, inlen);
+		kat_duplex(ref.sm, KAT_RATE, in, inlen * 8, NULL, 0);
+	}
+	if (rounds == 0 && width == 0)
+		rv |= mmcrypt_stretch(&ctx, iter, c, s);
+	else
+		rv |= mmcrypt_stretch_params(&ctx, &p);
+	rv |= mmcrypt_table_node(&ctx) >= mmcrypt_numa_nodes();
+	kat_stretch(&ref, iter, c, s, rounds, width);
+	rv |= mmcrypt_squeeze(&ctx, key, sizeof(key));
+	kat_duplex(ref.sm, KAT_RATE, NULL, 0, refkey, 512);
+	mmcrypt_destroy(&ctx);
+	kat_hex(hex, key, sizeof(key));
+	kat_check(rv == 0 && memcmp(key, refkey, sizeof(key)) == 0,
+	    "mmcrypt(%u, %u, %u, %u rounds, %u width%s) = %s", iter, c, s,
+	    rounds, width, layout == MMCRYPT_LAYOUT_LANE ? ", lane-major" : "",
+	    hex);
+}
+
+static void
+kat_test_absorb_stream(size_t len)
+{
+	struct mmcrypt_ctx ctx;
+	struct kat_ctx ref;
+	uint8_t *in, key[64], refkey[64], digest[65];
+	size_t off, n;
+	int rv;
+
+	in = malloc(len + 1);
+	if (in == NULL)
+		err(1, "malloc");
+	kat_fill(in, len);
+	mmcrypt_init(&ctx);
+	rv = mmcrypt_absorb(&ctx, "tag", 3);
+	rv |= mmcrypt_absorb_begin(&ctx);
+	for (off = 0; off < len; off += n) {
+		n = kat_rand(len - off) + 1;
+		rv |= mmcrypt_absorb_update(&ctx, in + off, n);
+	}
+	rv |= mmcrypt_absorb_final(&ctx);
+	rv |= mmcrypt_squeeze(&ctx, key, sizeof(key));
+	mmcrypt_destroy(&ctx);
+
+	memset(&ref, 0, sizeof(ref));
+	kat_duplex(ref.sm, KAT_RATE, (const uint8_t *)"tag", 24, NULL, 0);
+	kat_sponge(KAT_RATE, in, len, digest, 64);
+	digest[64] = 0x01;
+	kat_duplex(ref.sm, KAT_RATE, digest, 513, NULL, 0);
+	kat_duplex(ref.sm, KAT_RATE, NULL, 0, refkey, 512);
+	kat_check(rv == 0 && memcmp(key, refkey, sizeof(key)) == 0,
+	    "mmcrypt_absorb_update %zu bytes", len);
+	free(in);
+}
+
+static void
+kat_test_tree(size_t len, int threads)
+{
+	struct mmcrypt_ctx ctx;
+	struct kat_ctx ref;
+	uint8_t *in, key[64], refkey[64], digest[65], refdigest[64];
+	int rv;
+
+	in = calloc(1, len + 1);
+	if (in == NULL)
+		err(1, "calloc");
+	kat_fill(in, len);
+	rv = mmcrypt_tree_hash(in, len, digest, threads);
+	kat_tree(in, len, refdigest);
+	mmcrypt_init(&ctx);
+	rv |= mmcrypt_absorb(&ctx, "tag", 3);
+	rv |= mmcrypt_absorb_tree(&ctx, in, len, threads);
+	rv |= mmcrypt_squeeze(&ctx, key, sizeof(key));
+	mmcrypt_destroy(&ctx);
+
+	memset(&ref, 0, sizeof(ref));
+	kat_duplex(ref.sm, KAT_RATE, (const uint8_t *)"tag", 24, NULL, 0);
+	memcpy(digest, refdigest, 64);
+	digest[64] = 0x02;
+	kat_duplex(ref.sm, KAT_RATE, digest, 514, NULL, 0);
+	kat_duplex(ref.sm, KAT_RATE, NULL, 0, refkey, 512);
+	kat_check(rv == 0 && memcmp(digest, refdigest, 64) == 0 &&
+	    memcmp(key, refkey, sizeof(key)) == 0,
+	    "mmcrypt_absorb_tree %zu bytes, %d threads", len, threads);
+	free(in);
+}
+
+static void
+kat_test_squeeze_long(void)
+{
+	struct mmcrypt_ctx ctx, snap;
+	struct kat_ctx ref;
+	uint8_t key[1000 + 1], refkey[sizeof(key)], sub[32], refsub[32];
+	uint8_t other[32], label[MMCRYPT_LABEL_MAX + 2];
+	size_t off, n;
+	int rv, bad;
+
+	mmcrypt_init(&ctx);
+	memset(&ref, 0, sizeof(ref));
+	rv = mmcrypt_absorb(&ctx, "password", 8);
+	kat_duplex(ref.sm, KAT_RATE, (const uint8_t *)"password", 64, NULL, 0);
+	rv |= mmcrypt_derive(&ctx, "subkey", sub, sizeof(sub));
+	/* Squeeze from a snapshot restored over a diverged context. */
+	mmcrypt_ctx_clone(&snap, &ctx);
+	rv |= mmcrypt_absorb(&ctx, "diverged", 8);
+	mmcrypt_ctx_clone(&ctx, &snap);
+	mmcrypt_destroy(&snap);
+	rv |= mmcrypt_squeeze_long(&ctx, key + 1, sizeof(key) - 1);
+	mmcrypt_destroy(&ctx);
+
+	memcpy(refkey, ref.sm, sizeof(ref.sm));
+	kat_duplex(refkey, KAT_RATE, (const uint8_t *)"subkey\x03", 50, NULL, 0);
+	kat_duplex(refkey, KAT_RATE, NULL, 0, refsub, 256);
+	for (off = 1; off < sizeof(refkey); off += n) {
+		n = sizeof(refkey) - off < 72 ? sizeof(refkey) - off : 72;
+		kat_duplex(ref.sm, KAT_RATE, NULL, 0, refkey + off, n * 8);
+	}
+	kat_check(rv == 0 && memcmp(key + 1, refkey + 1, sizeof(key) - 1) == 0,
+	    "mmcrypt_squeeze_long %zu bytes", sizeof(key) - 1);
+	kat_check(rv == 0 && memcmp(sub, refsub, sizeof(sub)) == 0,
+	    "mmcrypt_derive");
+
+	/* Subkeys differ from squeezes with or without the label absorbed. */
+	mmcrypt_init(&ctx);
+	rv = mmcrypt_absorb(&ctx, "password", 8);
+	rv |= mmcrypt_derive(&ctx, "subkey", sub, sizeof(sub));
+	mmcrypt_ctx_clone(&snap, &ctx);
+	rv |= mmcrypt_squeeze(&snap, other, sizeof(other));
+	bad = memcmp(sub, other, sizeof(sub)) == 0;
+	rv |= mmcrypt_squeeze(&snap, other, sizeof(other));
+	bad |= memcmp(sub, other, sizeof(sub)) == 0;
+	mmcrypt_ctx_clone(&snap, &ctx);
+	rv |= mmcrypt_absorb(&snap, "subkey", 6);
+	rv |= mmcrypt_squeeze_long(&snap, other, sizeof(other));
+	bad |= memcmp(sub, other, sizeof(sub)) == 0;
+	mmcrypt_destroy(&snap);
+	kat_check(rv == 0 && !bad,
+	    "mmcrypt_derive differs from mmcrypt_squeeze");
+
+	/* Empty and overlong labels are rejected. */
+	memset(label, 'a', sizeof(label) - 1);
+	label[sizeof(label) - 1] = '\0';
+	bad = mmcrypt_derive(&ctx, "", sub, sizeof(sub)) == 0;
+	bad |= mmcrypt_derive(&ctx, (const char *)label, sub,
+	    sizeof(sub)) == 0;
+	label[MMCRYPT_LABEL_MAX] = '\0';
+	bad |= mmcrypt_derive(&ctx, (const char *)label, sub,
+	    sizeof(sub)) != 0;
+	mmcrypt_destroy(&ctx);
+	kat_check(!bad, "mmcrypt_derive label length");
+}
+
+/* Concurrent stretches. */
+
+struct kat_stress {
+	pthread_t thread;
+	int passes;
+	int failures;
+};
+
+static uint8_t kat_stress_keys[KAT_VECTORS][64];
+static uint8_t kat_stress_stream_key[64];
+
+static int
+kat_stress_stream(uint8_t *key, size_t keylen)
+{
+	struct mmcrypt_ctx ctx;
+	uint8_t data[KAT_STRESS_STREAM];
+	size_t i;
+	int rv;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = i * 31;
+	mmcrypt_init(&ctx);
+	rv = mmcrypt_absorb_begin(&ctx);
+	for (i = 0; i < sizeof(data); i += 100)
+		rv |= mmcrypt_absorb_update(&ctx, data + i,
+		    sizeof(data) - i < 100 ? sizeof(data) - i : 100);
+	rv |= mmcrypt_absorb_final(&ctx);
+	rv |= mmcrypt_stretch(&ctx, 1, 2, 5);
+	rv |= mmcrypt_squeeze_long(&ctx, key, keylen);
+	mmcrypt_destroy(&ctx);
+	return rv;
+}
+
+static void *
+kat_stress_thread(void *arg)
+{
+	struct kat_stress *st = arg;
+	uint8_t key[64];
+	size_t i;
+	int pass;
+
+	for (pass = 0; pass < st->passes; pass++) {
+		for (i = 0; i < KAT_VECTORS; i++) {
+			if (kat_vectors[i].c > KAT_STRESS_C_MAX)
+				continue;
+			if (kat_vector_key(&kat_vectors[i], key,
+			    sizeof(key)) != 0 ||
+			    memcmp(key, kat_stress_keys[i], sizeof(key)) != 0)
+				st->failures++;
+		}
+		if (kat_stress_stream(key, sizeof(key)) != 0 ||
+		    memcmp(key, kat_stress_stream_key, sizeof(key)) != 0)
+			st->failures++;
+	}
+	return NULL;
+}
+
+static void
+kat_test_stress(int nthreads, int passes)
+{
+	struct kat_stress *st;
+	size_t i;
+	int failures, rv, n;
+
+	/* Expected results computed before any thread starts. */
+	rv = 0;
+	for (i = 0; i < KAT_VECTORS; i++) {
+		if (kat_vectors[i].c > KAT_STRESS_C_MAX)
+			continue;
+		rv |= kat_vector_key(&kat_vectors[i], kat_stress_keys[i],
+		    sizeof(kat_stress_keys[i]));
+	}
+	rv |= kat_stress_stream(kat_stress_stream_key,
+	    sizeof(kat_stress_stream_key));
+	kat_check(rv == 0, "stress single threaded setup");
+
+	st = calloc(nthreads, sizeof(*st));
+	if (st == NULL)
+		err(1, "calloc");
+	for (n = 0; n < nthreads; n++) {
+		st[n].passes = passes;
+		rv = pthread_create(&st[n].thread, NULL, kat_stress_thread,
+		    &st[n]);
+		if (rv != 0) {
+			errno = rv;
+			err(1, "pthread_create");
+		}
+	}
+	failures = 0;
+	for (n = 0; n < nthreads; n++) {
+		pthread_join(st[n].thread, NULL);
+		failures += st[n].failures;
+	}
+	free(st);
+	kat_check(failures == 0, "stress %d threads, %d passes, %d failures",
+	    nthreads, passes, failures);
+}
+
+/* Pool jobs completed through callback, the rest through reap. */
+struct kat_pool_job {
+	struct mmcrypt_ctx ctx;
+	size_t vector;
+	int status;
+	int done;
+};
+
+static pthread_mutex_t kat_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t kat_pool_cv = PTHREAD_COND_INITIALIZER;
+
+static void
+kat_pool_done(void *arg, struct mmcrypt_ctx *ctx, int status)
+{
+	struct kat_pool_job *job = arg;
+
+	pthread_mutex_lock(&kat_pool_lock);
+	job->status = status;
+	job->done = 1;
+	pthread_cond_broadcast(&kat_pool_cv);
+	pthread_mutex_unlock(&kat_pool_lock);
+}
+
+static void
+kat_test_pool(int nthreads, int passes)
+{
+	struct mmcrypt_pool_config cfg;
+	struct mmcrypt_pool_stats st;
+	struct mmcrypt_params p;
+	struct mmcrypt_pool *pool;
+	struct kat_pool_job *jobs, *job;
+	struct mmcrypt_ctx *ctx;
+	struct pollfd pfd;
+	uint8_t key[64];
+	size_t i, mem_max, njobs, reaped, nreap;
+	int failures, status;
+	void *arg;
+
+	mem_max = 0;
+	njobs = 0;
+	for (i = 0; i < KAT_VECTORS; i++) {
+		if (kat_vectors[i].c > KAT_STRESS_C_MAX)
+			continue;
+		p.iter = kat_vectors[i].iter;
+		p.c = kat_vectors[i].c;
+		p.s = kat_vectors[i].s;
+		p.rounds = 0;
+		p.width = 0;
+		if (mmcrypt_memsize(&p) > mem_max)
+			mem_max = mmcrypt_memsize(&p);
+		njobs++;
+	}
+	njobs *= passes;
+	jobs = calloc(njobs, sizeof(jobs[0]));
+	if (jobs == NULL)
+		err(1, "calloc");
+	/* Tight memory ceiling, large jobs wait or are bypassed. */
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.workers = nthreads;
+	cfg.mem_max = mem_max * 2 + 256;
+	pool = mmcrypt_pool_create(&cfg);
+	if (pool == NULL)
+		errx(1, "mmcrypt_pool_create failed");
+
+	failures = 0;
+	nreap = 0;
+	for (i = 0, job = jobs; job < jobs + njobs; i = (i + 1) % KAT_VECTORS) {
+		if (kat_vectors[i].c > KAT_STRESS_C_MAX)
+			continue;
+		job->vector = i;
+		p.iter = kat_vectors[i].iter;
+		p.c = kat_vectors[i].c;
+		p.s = kat_vectors[i].s;
+		p.rounds = 0;
+		p.width = 0;
+		if (kat_vector_absorb(&kat_vectors[i], &job->ctx) != 0 ||
+		    mmcrypt_pool_submit(pool, &job->ctx, &p,
+		    (job - jobs) % 2 == 0 ? kat_pool_done : NULL, job) != 0) {
+			/* No callback or reap will complete it. */
+			job->status = EINVAL;
+			job->done = 1;
+			failures++;
+		} else if ((job - jobs) % 2 != 0)
+			nreap++;
+		job++;
+	}
+
+	pfd.fd = mmcrypt_pool_fd(pool);
+	pfd.events = POLLIN;
+	for (reaped = 0; reaped < nreap; ) {
+		if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+			err(1, "poll");
+		while (mmcrypt_pool_reap(pool, &ctx, &arg, &status) == 0) {
+			job = arg;
+			if (ctx != &job->ctx)
+				failures++;
+			job->status = status;
+			job->done = 1;
+			reaped++;
+		}
+	}
+	pthread_mutex_lock(&kat_pool_lock);
+	for (job = jobs; job < jobs + njobs; job++)
+		while (!job->done && (job - jobs) % 2 == 0)
+			pthread_cond_wait(&kat_pool_cv, &kat_pool_lock);
+	pthread_mutex_unlock(&kat_pool_lock);
+
+	for (job = jobs; job < jobs + njobs; job++) {
+		if (job->status != 0 ||
+		    mmcrypt_squeeze(&job->ctx, key, sizeof(key)) != 0 ||
+		    memcmp(key, kat_stress_keys[job->vector], sizeof(key)) != 0)
+			failures++;
+		mmcrypt_destroy(&job->ctx);
+	}
+	mmcrypt_pool_stats(pool, &st);
+	mmcrypt_pool_destroy(pool);
+	free(jobs);
+	kat_check(failures == 0 && st.completed == njobs &&
+	    st.mem_used <= cfg.mem_max,
+	    "pool %d workers, %zu jobs, %ju stolen, %ju bypassed, "
+	    "%d failures", nthreads, njobs, (uintmax_t)st.stolen,
+	    (uintmax_t)st.bypassed, failures);
+}
+
+static void
+kat_test_all(const char *prog, int rounds, uint64_t seed)
+{
+	/*
+	 * Fixed differential points, (2, 6, 17) hits feedback duplexing.
+	 * Fill rounds 24 and row width 64 must give the same keys as the
+	 * default 0.  The reference has no layout, lane-major must match it.
+	 */
+	static const uint32_t points[][6] = {
+		{ 1, 1, 1, 0, 0, 0 }, { 1, 1, 7, 0, 0, 0 }, { 3, 2, 3, 0, 0, 0 },
+		{ 1, 4, 17, 0, 0, 0 }, { 2, 6, 17, 0, 0, 0 },
+		{ 1, 7, 337, 0, 0, 0 },
+		{ 1, 4, 17, 24, 0, 0 }, { 1, 4, 17, 0, 64, 0 },
+		{ 1, 1, 7, 12, 0, 0 }, { 3, 2, 3, 12, 0, 0 },
+		{ 2, 6, 17, 12, 0, 0 }, { 1, 7, 337, 12, 0, 0 },
+		{ 1, 1, 1, 0, 128, 0 }, { 3, 2, 3, 0, 1024, 0 },
+		{ 2, 4, 5, 12, 256, 0 }, { 1, 2, 3, 0, 8192, 0 },
+		{ 1, 1, 1, 0, 0, 1 }, { 3, 2, 3, 0, 0, 1 }, { 2, 6, 17, 0, 0, 1 },
+		{ 1, 7, 337, 0, 0, 1 }, { 2, 4, 5, 12, 256, 1 },
+	};
+	/* Single node, one leaf, partial leaf, more leaves than a batch. */
+	static const size_t treelens[] = {
+		0, 1, MMCRYPT_TREE_CHUNK, MMCRYPT_TREE_CHUNK + 1,
+		2 * MMCRYPT_TREE_CHUNK, 40 * MMCRYPT_TREE_CHUNK + 77,
+	};
+	int i;
+
+#if BYTE_ORDER == LITTLE_ENDIAN
+	kat_test_vectors();
+#endif
+	kat_test_keccak();
+	kat_test_duplex(64);
+	kat_test_sponge(16);
+	kat_test_hash_many(16);
+	kat_test_absorb_stream(0);
+	kat_test_absorb_stream(71);
+	kat_test_absorb_stream(1 << 20);
+	kat_test_squeeze_long();
+	for (i = 0; i < (int)(sizeof(treelens) / sizeof(treelens[0])); i++)
+		kat_test_tree(treelens[i], 1 + i % 3);
+	for (i = 0; i < (int)(sizeof(points) / sizeof(points[0])); i++)
+		kat_test_stretch(points[i][0], points[i][1], points[i][2],
+		    points[i][3], points[i][4], points[i][5]);
+
+	if (rounds > 0) {
+		printf("%s: %s backend, %d random rounds, seed %ju\n", prog,
+		    KeccakImplementation(), rounds, (uintmax_t)seed);
+		kat_rng_state ^= seed;
+		if (kat_rng_state == 0)
+			kat_rng_state = 1;
+		kat_test_duplex(rounds * 16);
+		kat_test_sponge(rounds);
+		kat_test_hash_many(rounds);
+		for (i = 0; i < rounds; i++)
+			kat_test_stretch(1 + kat_rand(3), 1 + kat_rand(6),
+			    1 + kat_rand(64), kat_rand(2) * 12,
+			    kat_rand(2) * (64 << kat_rand(4)), i % 2);
+	}
+}
+
+static void
+usage(const char *prog)
+{
+	fprintf(stderr,
+	    "usage: %s [-v] [-r rounds] [-S seed] [-t threads [-n passes]]\n",
+	    prog);
+	exit(-1);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *prog = basename(argv[0]);
+	uint64_t seed;
+	int rounds = 0, threads = 0, passes = 4;
+	int ch;
+
+	seed = time(NULL);
+	while ((ch = getopt(argc, argv, "n:r:S:t:v")) != -1) {
+		switch (ch) {
+		case 'n':
+			passes = atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 'S':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 'v':
+			kat_verbose = 1;
+			break;
+		default:
+			usage(prog);
+		}
+	}
+	if (optind != argc || rounds < 0 || threads < 0 || passes < 1)
+		usage(prog);
+
+	if (threads > 0) {
+		printf("%s: %s backend, %d threads, %d passes\n", prog,
+		    KeccakImplementation(), threads, passes);
+		kat_test_stress(threads, passes);
+		kat_test_pool(threads, passes);
+	} else
+		kat_test_all(prog, rounds, seed);
+
+	printf("%s: %s backend: %s\n", prog, KeccakImplementation(),
+	    kat_failures == 0 ? "passed" : "FAILED");
+	return kat_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,227 @@
+/*-
+ * Author: Gleb Kurtsou <gleb@FreeBSD.org>
+ *
+ * This software is hereby placed in the public domain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mmcrypt-numa.h"
+
+#define NUMA_ALIGN		64
+#define NUMA_NODE_CPUS_MAX	256
+#define NUMA_MASK_BITS		(8 * sizeof(unsigned long))
+#define NUMA_MASK_WORDS		\
+	((MMCRYPT_NUMA_NODES_MAX + NUMA_MASK_BITS - 1) / NUMA_MASK_BITS)
+
+/* Topology is read once, CPUs of every node in ascending order. */
+static struct {
+	int nodes;
+	int ncpus[MMCRYPT_NUMA_NODES_MAX];
+	int cpus[MMCRYPT_NUMA_NODES_MAX][NUMA_NODE_CPUS_MAX];
+	unsigned long mask[NUMA_MASK_WORDS];
+} numa;
+
+static pthread_once_t numa_once = PTHREAD_ONCE_INIT;
+
+#if defined(__linux__)
+/* Parse "0-3,8,10-11" into v, returns number of entries. */
+static int
+numa_parse_list(const char *s, int *v, int max)
+{
+	char *end;
+	long a, b;
+	int n = 0;
+
+	while (*s != '\0' && *s != '\n') {
+		a = strtol(s, &end, 10);
+		if (end == s)
+			break;
+		b = a;
+		if (*end == '-')
+			b = strtol(end + 1, &end, 10);
+		for (; a <= b && n < max; a++)
+			v[n++] = a;
+		s = *end == ',' ? end + 1 : end;
+	}
+	return n;
+}
+
+static int
+numa_read_list(const char *path, int *v, int max)
+{
+	char buf[4096];
+	FILE *f;
+	int n = 0;
+
+	f = fopen(path, "r");
+	if (f == NULL)
+		return 0;
+	if (fgets(buf, sizeof(buf), f) != NULL)
+		n = numa_parse_list(buf, v, max);
+	fclose(f);
+	return n;
+}
+#endif
+
+static void
+numa_init(void)
+{
+#if defined(__linux__)
+	char path[128];
+	int ids[MMCRYPT_NUMA_NODES_MAX];
+	int i, n;
+
+	n = numa_read_list("/sys/devices/system/node/online", ids,
+	    MMCRYPT_NUMA_NODES_MAX);
+	for (i = 0; i < n; i++) {
+		if (ids[i] < 0 || ids[i] >= MMCRYPT_NUMA_NODES_MAX)
+			continue;
+		snprintf(path, sizeof(path),
+		    "/sys/devices/system/node/node%d/cpulist", ids[i]);
+		numa.ncpus[numa.nodes] = numa_read_list(path,
+		    numa.cpus[numa.nodes], NUMA_NODE_CPUS_MAX);
+		numa.mask[ids[i] / NUMA_MASK_BITS] |=
+		    1UL << (ids[i] % NUMA_MASK_BITS);
+		numa.nodes++;
+	}
+#endif
+	if (numa.nodes == 0)
+		numa.nodes = 1;
+}
+
+int
+mmcrypt_numa_nodes(void)
+{
+	pthread_once(&numa_once, numa_init);
+	return numa.nodes;
+}
+
+int
+mmcrypt_numa_node(void)
+{
+#if defined(__linux__) && defined(SYS_getcpu)
+	unsigned int cpu, node;
+
+	if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0)
+		return node;
+#endif
+	return 0;
+}
+
+int
+mmcrypt_numa_node_of(const void *addr)
+{
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+	int node;
+
+	if (syscall(SYS_get_mempolicy, &node, NULL, 0, addr,
+	    MPOL_F_NODE | MPOL_F_ADDR) == 0)
+		return node;
+	return -1;
+#else
+	return addr != NULL ? 0 : -1;
+#endif
+}
+
+int
+mmcrypt_numa_cpu_order(int *cpus, int ncpus)
+{
+	long online;
+	int i, k, n, more;
+
+	pthread_once(&numa_once, numa_init);
+	n = 0;
+	for (k = 0, more = 1; more && n < ncpus; k++) {
+		more = 0;
+		for (i = 0; i < numa.nodes && n < ncpus; i++) {
+			if (k >= numa.ncpus[i])
+				continue;
+			cpus[n++] = numa.cpus[i][k];
+			more = 1;
+		}
+	}
+	if (n == 0) {
+		online = sysconf(_SC_NPROCESSORS_ONLN);
+		for (; n < ncpus && n < online; n++)
+			cpus[n] = n;
+	}
+	return n;
+}
+
+void *
+mmcrypt_numa_alloc(size_t len, enum mmcrypt_mempolicy policy)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+	unsigned long mask[NUMA_MASK_WORDS];
+	void *mem;
+	int node, mode;
+
+	if (mmcrypt_numa_nodes() <= 1)
+		goto fallback;
+	mem = mmap(NULL, len, PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+		return NULL;
+	if (policy == MMCRYPT_MEM_DEFAULT)
+		return mem;
+	if (policy == MMCRYPT_MEM_INTERLEAVE) {
+		mode = MPOL_INTERLEAVE;
+		memcpy(mask, numa.mask, sizeof(mask));
+	} else {
+		/* Preferred, not strict: full node falls back, no OOM. */
+		mode = MPOL_PREFERRED;
+		node = mmcrypt_numa_node();
+		memset(mask, 0, sizeof(mask));
+		if (node < MMCRYPT_NUMA_NODES_MAX)
+			mask[node / NUMA_MASK_BITS] |=
+			    1UL << (node % NUMA_MASK_BITS);
+	}
+	/* Placement is best effort, memory is usable either way. */
+	syscall(SYS_mbind, mem, len, mode, mask,
+	    (unsigned long)MMCRYPT_NUMA_NODES_MAX + 1, 0);
+	return mem;
+fallback:
+#endif
+	if (len > SIZE_MAX - NUMA_ALIGN)
+		return NULL;
+	return aligned_alloc(NUMA_ALIGN,
+	    (len + NUMA_ALIGN - 1) / NUMA_ALIGN * NUMA_ALIGN);
+}
+
+void
+mmcrypt_numa_free(void *mem, size_t len)
+{
+	if (mem == NULL)
+		return;
+#if defined(__linux__) && defined(SYS_mbind)
+	if (mmcrypt_numa_nodes() > 1) {
+		munmap(mem, len);
+		return;
+	}
+#endif
+	free(mem);
+}
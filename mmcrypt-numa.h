@@ -0,0 +1,71 @@
+/*-
+ * Author: Gleb Kurtsou <gleb@FreeBSD.org>
+ *
+ * This software is hereby placed in the public domain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MMCRYPT_NUMA_H_
+#define MMCRYPT_NUMA_H_
+
+#include <stddef.h>
+
+#include "mmcrypt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * NUMA placement of table memory.  Traversal is a random DRAM access per
+ * step, tables on a remote node run at a fraction of the local speed.
+ *
+ * Uses mbind() and get_mempolicy() system calls directly, no libnuma.
+ * On single node hosts and other systems allocation falls back to the
+ * C library and everything is reported as node 0.
+ */
+
+#define MMCRYPT_NUMA_NODES_MAX	64
+
+/* Online nodes, 1 if unknown. */
+int mmcrypt_numa_nodes(void);
+
+/* Node of the CPU calling thread runs on, 0 if unknown. */
+int mmcrypt_numa_node(void);
+
+/* Node backing the page at addr, -1 if unknown or not faulted in. */
+int mmcrypt_numa_node_of(const void *addr);
+
+/*
+ * Fill cpus with online CPUs taking one from every node in turn, so that
+ * pinning thread i to cpus[i % n] spreads threads evenly over nodes.
+ * Returns number of CPUs.
+ */
+int mmcrypt_numa_cpu_order(int *cpus, int ncpus);
+
+/*
+ * Allocate 64-byte aligned memory placed according to policy:
+ * MMCRYPT_MEM_LOCAL on the calling thread's node, MMCRYPT_MEM_INTERLEAVE
+ * page by page over all nodes.  Free with mmcrypt_numa_free() of the
+ * same length.
+ */
+void *mmcrypt_numa_alloc(size_t len, enum mmcrypt_mempolicy policy);
+
+void mmcrypt_numa_free(void *mem, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
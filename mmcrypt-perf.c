@@ -0,0 +1,181 @@
+/*-
+ * Author: Gleb Kurtsou <gleb@FreeBSD.org>
+ *
+ * This software is hereby placed in the public domain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mmcrypt-perf.h"
+
+static const char *perf_counter_names[PERF_COUNTER_MAX] = {
+	[PERF_CYCLES] = "cycles",
+	[PERF_INSTRUCTIONS] = "instructions",
+	[PERF_LLC_MISSES] = "llc-misses",
+	[PERF_DTLB_MISSES] = "dtlb-misses",
+	[PERF_STALLED_CYCLES] = "stalled-cycles",
+};
+
+static const char *perf_phase_names[MMCRYPT_PHASE_MAX] = {
+	[MMCRYPT_PHASE_STRETCH] = "stretch",
+	[MMCRYPT_PHASE_SETUP] = "setup",
+	[MMCRYPT_PHASE_FILL] = "fill",
+	[MMCRYPT_PHASE_TRAVERSE] = "traverse",
+	[MMCRYPT_PHASE_WIPE] = "wipe",
+};
+
+#if defined(__linux__)
+#define PERF_CACHE_MISS(cache)						\
+	((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) |			\
+	    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct {
+	uint32_t type;
+	uint64_t config;
+} perf_counter_events[PERF_COUNTER_MAX] = {
+	[PERF_CYCLES] = {
+		PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	[PERF_INSTRUCTIONS] = {
+		PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	[PERF_LLC_MISSES] = {
+		PERF_TYPE_HW_CACHE, PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_LL) },
+	[PERF_DTLB_MISSES] = {
+		PERF_TYPE_HW_CACHE, PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB) },
+	[PERF_STALLED_CYCLES] = {
+		PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_BACKEND },
+};
+
+static int
+perf_open_counter(uint32_t type, uint64_t config)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	/* Unprivileged users and containers may only count user space. */
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+int
+perf_open(struct perf_counters *pc)
+{
+	int i, n;
+
+	memset(pc, 0, sizeof(*pc));
+	for (i = 0, n = 0; i < PERF_COUNTER_MAX; i++) {
+#if defined(__linux__)
+		pc->fd[i] = perf_open_counter(perf_counter_events[i].type,
+		    perf_counter_events[i].config);
+#else
+		pc->fd[i] = -1;
+#endif
+		if (pc->fd[i] >= 0)
+			n++;
+	}
+	return n;
+}
+
+void
+perf_close(struct perf_counters *pc)
+{
+	int i;
+
+	for (i = 0; i < PERF_COUNTER_MAX; i++) {
+		if (pc->fd[i] >= 0)
+			close(pc->fd[i]);
+		pc->fd[i] = -1;
+	}
+}
+
+void
+perf_reset(struct perf_counters *pc)
+{
+	memset(pc->start, 0, sizeof(pc->start));
+	memset(pc->total, 0, sizeof(pc->total));
+}
+
+void
+perf_hook(void *arg, enum mmcrypt_phase phase, int end)
+{
+	struct perf_counters *pc = arg;
+	uint64_t v;
+	int i;
+
+	for (i = 0; i < PERF_COUNTER_MAX; i++) {
+		if (pc->fd[i] < 0)
+			continue;
+		if (read(pc->fd[i], &v, sizeof(v)) != sizeof(v))
+			continue;
+		if (end)
+			pc->total[phase][i] += v - pc->start[phase][i];
+		else
+			pc->start[phase][i] = v;
+	}
+}
+
+static void
+perf_report_line(FILE *f, struct perf_counters *pc, const char *prefix,
+    const char *name, enum mmcrypt_phase phase, double units)
+{
+	int i;
+
+	fprintf(f, "%s %-14s", prefix, name);
+	for (i = 0; i < PERF_COUNTER_MAX; i++) {
+		if (pc->fd[i] < 0)
+			fprintf(f, " %15s", "n/a");
+		else if (units == 0)
+			fprintf(f, " %15ju", (uintmax_t)pc->total[phase][i]);
+		else
+			fprintf(f, " %15.2lf", pc->total[phase][i] / units);
+	}
+	fprintf(f, "\n");
+}
+
+void
+perf_report(FILE *f, struct perf_counters *pc,
+    uint32_t iter, uint32_t c, uint32_t s)
+{
+	const double rows = (double)(1ULL << (c + 1)) * s * iter;
+	const double steps = (double)((1ULL << (2 * c)) - 1) * s * iter;
+	char prefix[64];
+	int i;
+
+	snprintf(prefix, sizeof(prefix), "mmcrypt(%u, %u, %u):", iter, c, s);
+	fprintf(f, "%s %-14s", prefix, "perf");
+	for (i = 0; i < PERF_COUNTER_MAX; i++)
+		fprintf(f, " %15s", perf_counter_names[i]);
+	fprintf(f, "\n");
+	for (i = 0; i < MMCRYPT_PHASE_MAX; i++) {
+		perf_report_line(f, pc, prefix, perf_phase_names[i], i, 0);
+		if (i == MMCRYPT_PHASE_FILL)
+			perf_report_line(f, pc, prefix, "fill/row", i, rows);
+		else if (i == MMCRYPT_PHASE_TRAVERSE)
+			perf_report_line(f, pc, prefix, "traverse/step", i,
+			    steps);
+	}
+}
@@ -0,0 +1,61 @@
+/*-
+ * Author: Gleb Kurtsou <gleb@FreeBSD.org>
+ *
+ * This software is hereby placed in the public domain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MMCRYPT_PERF_H_
+#define MMCRYPT_PERF_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "mmcrypt.h"
+
+/*
+ * Hardware performance counters sampled around mmcrypt_stretch() phases.
+ * Counters unsupported by the kernel, hardware or container are reported
+ * as not available, the rest keep working.
+ */
+
+enum perf_counter {
+	PERF_CYCLES = 0,
+	PERF_INSTRUCTIONS,
+	PERF_LLC_MISSES,
+	PERF_DTLB_MISSES,
+	PERF_STALLED_CYCLES,
+	PERF_COUNTER_MAX
+};
+
+struct perf_counters {
+	int fd[PERF_COUNTER_MAX];
+	uint64_t start[MMCRYPT_PHASE_MAX][PERF_COUNTER_MAX];
+	uint64_t total[MMCRYPT_PHASE_MAX][PERF_COUNTER_MAX];
+};
+
+/* Returns number of available counters. */
+int perf_open(struct perf_counters *pc);
+
+void perf_close(struct perf_counters *pc);
+
+void perf_reset(struct perf_counters *pc);
+
+/* mmcrypt_hook_t accumulating counters per phase, arg is perf_counters. */
+void perf_hook(void *arg, enum mmcrypt_phase phase, int end);
+
+void perf_report(FILE *f, struct perf_counters *pc,
+    uint32_t iter, uint32_t c, uint32_t s);
+
+#endif
@@ -0,0 +1,482 @@
+/*-
+ * Author: Gleb Kurtsou <gleb@FreeBSD.org>
+ *
+ * This software is hereby placed in the public domain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <sys/queue.h>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#if defined(__linux__)
+#include <sched.h>
+#elif defined(__FreeBSD__)
+#include <pthread_np.h>
+#include <sys/cpuset.h>
+#endif
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mmcrypt-numa.h"
+#include "mmcrypt-pool.h"
+
+#define POOL_ALIGN		64
+/* Times the oldest job may be passed over by smaller ones. */
+#define POOL_BYPASS_MAX		8
+
+struct pool_job {
+	TAILQ_ENTRY(pool_job) link;
+	struct mmcrypt_ctx *ctx;
+	struct mmcrypt_params params;
+	size_t mem;
+	mmcrypt_pool_cb_t *cb;
+	void *arg;
+	int status;
+	uint32_t bypassed;
+};
+
+TAILQ_HEAD(pool_queue, pool_job);
+
+struct pool_worker {
+	struct mmcrypt_pool *pool;
+	pthread_t td;
+	int cpu;
+	struct pool_queue queue;
+	uint32_t queued;
+	void *mem;
+	size_t memlen;
+};
+
+/*
+ * Jobs take from milliseconds to seconds, single pool lock protects the
+ * queues and accounting.
+ */
+struct mmcrypt_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	struct pool_worker *workers;
+	int nworkers;
+	int next;
+	int stopping;
+	size_t mem_max, mem_used;
+	uint32_t jobs_max, running;
+	uint32_t queue_max, queued;
+	struct pool_queue done;
+	int fd[2];
+	uint64_t submitted, completed, stolen, bypassed;
+	uint64_t node_jobs[MMCRYPT_NUMA_NODES_MAX], remote;
+};
+
+static void
+pool_pin(int cpu)
+{
+#if defined(__linux__)
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#elif defined(__FreeBSD__)
+	cpuset_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+static size_t
+pool_job_mem(const struct mmcrypt_params *p)
+{
+	size_t mem;
+
+	mem = mmcrypt_memsize(p);
+	if (mem == 0 || mem > SIZE_MAX - POOL_ALIGN)
+		return 0;
+	return (mem + POOL_ALIGN - 1) / POOL_ALIGN * POOL_ALIGN;
+}
+
+static int
+pool_fits(struct mmcrypt_pool *pool, struct pool_worker *w,
+    struct pool_job *job)
+{
+	size_t need;
+
+	need = job->mem > w->memlen ? job->mem - w->memlen : 0;
+	return pool->mem_used + need <= pool->mem_max;
+}
+
+static void
+pool_notify(struct mmcrypt_pool *pool)
+{
+	uint64_t one = 1;
+	ssize_t rv;
+
+	rv = write(pool->fd[1], &one, sizeof(one));
+	(void)rv;
+}
+
+static void
+pool_drain(struct mmcrypt_pool *pool)
+{
+	uint64_t v;
+
+	while (read(pool->fd[0], &v, sizeof(v)) > 0)
+		;
+}
+
+/*
+ * Pick next job for worker, own queue first, then the oldest job of the
+ * longest other queue.  If it doesn't fit in memory run the smallest job
+ * that does.  Called with pool lock held.
+ */
+static struct pool_job *
+pool_pick(struct mmcrypt_pool *pool, struct pool_worker *w)
+{
+	struct pool_worker *owner, *v, *best_owner;
+	struct pool_job *job, *best;
+	int i;
+
+	if (pool->running >= pool->jobs_max || pool->queued == 0)
+		return NULL;
+	owner = w;
+	if (w->queued == 0) {
+		for (i = 0; i < pool->nworkers; i++) {
+			v = &pool->workers[i];
+			if (v->queued > owner->queued)
+				owner = v;
+		}
+	}
+	job = TAILQ_FIRST(&owner->queue);
+	if (!pool_fits(pool, w, job)) {
+		if (job->bypassed >= POOL_BYPASS_MAX)
+			return NULL;
+		best = NULL;
+		best_owner = NULL;
+		for (i = 0; i < pool->nworkers; i++) {
+			v = &pool->workers[i];
+			TAILQ_FOREACH(job, &v->queue, link) {
+				if ((best == NULL || job->mem < best->mem) &&
+				    pool_fits(pool, w, job)) {
+					best = job;
+					best_owner = v;
+				}
+			}
+		}
+		if (best == NULL)
+			return NULL;
+		TAILQ_FIRST(&owner->queue)->bypassed++;
+		pool->bypassed++;
+		job = best;
+		owner = best_owner;
+	}
+	TAILQ_REMOVE(&owner->queue, job, link);
+	owner->queued--;
+	pool->queued--;
+	if (owner != w)
+		pool->stolen++;
+	return job;
+}
+
+static void *
+pool_worker_main(void *arg)
+{
+	struct pool_worker *w = arg;
+	struct mmcrypt_pool *pool = w->pool;
+	struct pool_job *job;
+	void *old;
+	size_t need, oldlen;
+	int node;
+
+	if (w->cpu >= 0)
+		pool_pin(w->cpu);
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		job = pool_pick(pool, w);
+		if (job == NULL) {
+			if (pool->stopping && pool->queued == 0)
+				break;
+			if (pool->queued != 0 && w->memlen != 0 &&
+			    pool->running < pool->jobs_max) {
+				/* Memory bound, give up own tables. */
+				old = w->mem;
+				oldlen = w->memlen;
+				pool->mem_used -= w->memlen;
+				w->mem = NULL;
+				w->memlen = 0;
+				pthread_mutex_unlock(&pool->lock);
+				mmcrypt_numa_free(old, oldlen);
+				pthread_mutex_lock(&pool->lock);
+				pthread_cond_broadcast(&pool->work);
+				continue;
+			}
+			pthread_cond_wait(&pool->work, &pool->lock);
+			continue;
+		}
+		need = job->mem > w->memlen ? job->mem - w->memlen : 0;
+		old = NULL;
+		oldlen = 0;
+		if (need != 0) {
+			old = w->mem;
+			oldlen = w->memlen;
+			pool->mem_used += need;
+			w->mem = NULL;
+			w->memlen = job->mem;
+		}
+		pool->running++;
+		pthread_mutex_unlock(&pool->lock);
+
+		if (need != 0) {
+			/* Worker is pinned, tables land on its node. */
+			mmcrypt_numa_free(old, oldlen);
+			w->mem = mmcrypt_numa_alloc(w->memlen, MMCRYPT_MEM_LOCAL);
+		}
+		if (w->mem == NULL)
+			job->status = ENOMEM;
+		else if (mmcrypt_stretch_mem(job->ctx, &job->params, w->mem,
+		    w->memlen) != 0)
+			job->status = EINVAL;
+		else
+			job->status = 0;
+		node = w->mem != NULL ? mmcrypt_numa_node_of(w->mem) : -1;
+
+		pthread_mutex_lock(&pool->lock);
+		if (node >= 0 && node < MMCRYPT_NUMA_NODES_MAX) {
+			pool->node_jobs[node]++;
+			if (node != mmcrypt_numa_node())
+				pool->remote++;
+		}
+		if (w->mem == NULL) {
+			pool->mem_used -= w->memlen;
+			w->memlen = 0;
+		}
+		pool->running--;
+		pool->completed++;
+		if (pool->queued != 0 || pool->stopping)
+			pthread_cond_broadcast(&pool->work);
+		if (job->cb == NULL) {
+			if (TAILQ_EMPTY(&pool->done))
+				pool_notify(pool);
+			TAILQ_INSERT_TAIL(&pool->done, job, link);
+			continue;
+		}
+		pthread_mutex_unlock(&pool->lock);
+		job->cb(job->arg, job->ctx, job->status);
+		free(job);
+		pthread_mutex_lock(&pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	mmcrypt_numa_free(w->mem, w->memlen);
+	return NULL;
+}
+
+static int
+pool_open_fd(int fd[2])
+{
+#if defined(__linux__)
+	fd[0] = fd[1] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	return fd[0] < 0;
+#else
+	if (pipe(fd) != 0)
+		return 1;
+	fcntl(fd[0], F_SETFL, O_NONBLOCK);
+	fcntl(fd[1], F_SETFL, O_NONBLOCK);
+	fcntl(fd[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fd[1], F_SETFD, FD_CLOEXEC);
+	return 0;
+#endif
+}
+
+static void
+pool_close_fd(int fd[2])
+{
+	close(fd[0]);
+	if (fd[1] != fd[0])
+		close(fd[1]);
+}
+
+struct mmcrypt_pool *
+mmcrypt_pool_create(const struct mmcrypt_pool_config *cfg)
+{
+	struct mmcrypt_pool *pool;
+	struct pool_worker *w;
+	int *cpus;
+	long ncpu;
+	int i;
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu < 1)
+		ncpu = 1;
+	pool = calloc(1, sizeof(*pool));
+	if (pool == NULL)
+		return NULL;
+	pool->nworkers = cfg->workers > 0 ? cfg->workers : ncpu;
+	cpus = calloc(ncpu, sizeof(cpus[0]));
+	if (cpus == NULL) {
+		free(pool);
+		return NULL;
+	}
+	/* Round robin over nodes, worker count scales all nodes evenly. */
+	ncpu = mmcrypt_numa_cpu_order(cpus, ncpu);
+	pool->mem_max = cfg->mem_max != 0 ? cfg->mem_max : SIZE_MAX;
+	pool->jobs_max = cfg->jobs_max != 0 ? cfg->jobs_max :
+	    (uint32_t)pool->nworkers;
+	pool->queue_max = cfg->queue_max != 0 ? cfg->queue_max : UINT32_MAX;
+	TAILQ_INIT(&pool->done);
+	pool->workers = calloc(pool->nworkers, sizeof(pool->workers[0]));
+	if (pool->workers == NULL || pool_open_fd(pool->fd) != 0) {
+		free(pool->workers);
+		free(pool);
+		free(cpus);
+		return NULL;
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	for (i = 0; i < pool->nworkers; i++) {
+		w = &pool->workers[i];
+		w->pool = pool;
+		w->cpu = cfg->pin && ncpu > 0 ? cpus[i % ncpu] : -1;
+		TAILQ_INIT(&w->queue);
+	}
+	free(cpus);
+	for (i = 0; i < pool->nworkers; i++) {
+		if (pthread_create(&pool->workers[i].td, NULL,
+		    pool_worker_main, &pool->workers[i]) != 0) {
+			pool->nworkers = i;
+			mmcrypt_pool_destroy(pool);
+			return NULL;
+		}
+	}
+	return pool;
+}
+
+void
+mmcrypt_pool_destroy(struct mmcrypt_pool *pool)
+{
+	struct pool_job *job;
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+	for (i = 0; i < pool->nworkers; i++)
+		pthread_join(pool->workers[i].td, NULL);
+	while ((job = TAILQ_FIRST(&pool->done)) != NULL) {
+		TAILQ_REMOVE(&pool->done, job, link);
+		free(job);
+	}
+	pool_close_fd(pool->fd);
+	pthread_cond_destroy(&pool->work);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->workers);
+	free(pool);
+}
+
+int
+mmcrypt_pool_submit(struct mmcrypt_pool *pool, struct mmcrypt_ctx *ctx,
+    const struct mmcrypt_params *p, mmcrypt_pool_cb_t *cb, void *arg)
+{
+	struct pool_worker *w;
+	struct pool_job *job;
+	size_t mem;
+
+	mem = pool_job_mem(p);
+	if (mem == 0)
+		return EINVAL;
+	if (mem > pool->mem_max)
+		return E2BIG;
+	job = calloc(1, sizeof(*job));
+	if (job == NULL)
+		return ENOMEM;
+	job->ctx = ctx;
+	job->params = *p;
+	job->mem = mem;
+	job->cb = cb;
+	job->arg = arg;
+	pthread_mutex_lock(&pool->lock);
+	if (pool->stopping || pool->queued >= pool->queue_max) {
+		pthread_mutex_unlock(&pool->lock);
+		free(job);
+		return EAGAIN;
+	}
+	w = &pool->workers[pool->next];
+	pool->next = (pool->next + 1) % pool->nworkers;
+	TAILQ_INSERT_TAIL(&w->queue, job, link);
+	w->queued++;
+	pool->queued++;
+	pool->submitted++;
+	/* Owner may be busy, any idle worker takes it. */
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+	return 0;
+}
+
+int
+mmcrypt_pool_fd(struct mmcrypt_pool *pool)
+{
+	return pool->fd[0];
+}
+
+int
+mmcrypt_pool_reap(struct mmcrypt_pool *pool, struct mmcrypt_ctx **ctx,
+    void **arg, int *status)
+{
+	struct pool_job *job;
+
+	pthread_mutex_lock(&pool->lock);
+	job = TAILQ_FIRST(&pool->done);
+	if (job != NULL) {
+		TAILQ_REMOVE(&pool->done, job, link);
+		if (TAILQ_EMPTY(&pool->done))
+			pool_drain(pool);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	if (job == NULL)
+		return 1;
+	*ctx = job->ctx;
+	*arg = job->arg;
+	*status = job->status;
+	free(job);
+	return 0;
+}
+
+void
+mmcrypt_pool_stats(struct mmcrypt_pool *pool, struct mmcrypt_pool_stats *st)
+{
+	pthread_mutex_lock(&pool->lock);
+	st->workers = pool->nworkers;
+	st->queued = pool->queued;
+	st->running = pool->running;
+	st->mem_used = pool->mem_used;
+	st->mem_max = pool->mem_max;
+	st->submitted = pool->submitted;
+	st->completed = pool->completed;
+	st->stolen = pool->stolen;
+	st->bypassed = pool->bypassed;
+	st->nodes = mmcrypt_numa_nodes();
+	memcpy(st->node_jobs, pool->node_jobs, sizeof(st->node_jobs));
+	st->remote = pool->remote;
+	pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,113 @@
+/*-
+ * Author: Gleb Kurtsou <gleb@FreeBSD.org>
+ *
+ * This software is hereby placed in the public domain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MMCRYPT_POOL_H_
+#define MMCRYPT_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mmcrypt.h"
+#include "mmcrypt-numa.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Exported from libmmcrypt.so, see mmcrypt.h. */
+#if defined(__GNUC__)
+#pragma GCC visibility push(default)
+#endif
+
+/*
+ * Asynchronous mmcrypt_stretch() on a pool of worker threads.
+ *
+ * Jobs are queued per worker, idle workers steal from the others.  Every
+ * worker keeps its table memory between jobs; memory held by all workers
+ * stays below mem_max and at most jobs_max jobs run at once.  When the
+ * oldest job does not fit in remaining memory smaller jobs that do fit
+ * are run first, a bypassed job gets priority after a few bypasses.
+ * Tables are allocated by the worker on its own NUMA node.
+ *
+ * Completion is reported by calling the callback on a worker thread, or,
+ * with no callback, by queueing the job for mmcrypt_pool_reap() and
+ * making mmcrypt_pool_fd() readable.  Context must not be used until its
+ * job completes.
+ */
+
+struct mmcrypt_pool;
+
+struct mmcrypt_pool_config {
+	int workers;			/* 0: online CPUs */
+	int pin;			/* pin workers to CPUs, nodes in turn */
+	size_t mem_max;			/* table memory, 0: unlimited */
+	uint32_t jobs_max;		/* running jobs, 0: workers */
+	uint32_t queue_max;		/* queued jobs, 0: unlimited */
+};
+
+struct mmcrypt_pool_stats {
+	uint32_t workers;
+	uint32_t queued;
+	uint32_t running;
+	size_t mem_used;
+	size_t mem_max;
+	uint64_t submitted;
+	uint64_t completed;
+	uint64_t stolen;		/* jobs run by a non-owner worker */
+	uint64_t bypassed;		/* smaller job run before oldest one */
+	uint32_t nodes;			/* NUMA nodes */
+	uint64_t node_jobs[MMCRYPT_NUMA_NODES_MAX]; /* by node of tables */
+	uint64_t remote;		/* tables not on worker's node */
+};
+
+/* Status is 0, ENOMEM if tables can't be allocated or EINVAL. */
+typedef void mmcrypt_pool_cb_t(void *arg, struct mmcrypt_ctx *ctx,
+    int status);
+
+struct mmcrypt_pool *mmcrypt_pool_create(
+    const struct mmcrypt_pool_config *cfg);
+
+/* Waits for queued jobs to complete. */
+void mmcrypt_pool_destroy(struct mmcrypt_pool *pool);
+
+/*
+ * Returns 0 if job is queued, EINVAL for invalid parameters, E2BIG if
+ * job can never fit in mem_max, EAGAIN if queue is full, ENOMEM.
+ */
+int mmcrypt_pool_submit(struct mmcrypt_pool *pool, struct mmcrypt_ctx *ctx,
+    const struct mmcrypt_params *p, mmcrypt_pool_cb_t *cb, void *arg);
+
+/* Readable while jobs submitted without callback wait to be reaped. */
+int mmcrypt_pool_fd(struct mmcrypt_pool *pool);
+
+/* Returns 0 if completed job is reaped, 1 if there is none. */
+int mmcrypt_pool_reap(struct mmcrypt_pool *pool, struct mmcrypt_ctx **ctx,
+    void **arg, int *status);
+
+void mmcrypt_pool_stats(struct mmcrypt_pool *pool,
+    struct mmcrypt_pool_stats *st);
+
+#if defined(__GNUC__)
+#pragma GCC visibility pop
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
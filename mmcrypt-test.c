@@ -23,8 +23,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <libgen.h>
+#include <unistd.h>
 
 #include "mmcrypt.h"
+#include "mmcrypt-perf.h"
 
 const char *
 dump_hex(unsigned char *b, size_t blen)
@@ -60,15 +62,37 @@ benchmark_result(int iter, int c, int s,
 	    iter, c, s, cells, hashes, mem >> 10, t);
 }
 
+static void
+usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-p] [iter] [c] [s]\n", prog);
+	exit(-1);
+}
+
 int
 main(int argc, char **argv)
 {
 	struct mmcrypt_ctx ctx;
+	struct perf_counters pc;
 	struct timeval tstart, tend;
 	unsigned char k1[512 / 8];
 	unsigned char k2[512 / 8];
 	int iter = 1, c = 7, s = 337;
-	int rv = 0;
+	const char *prog = basename(argv[0]);
+	int perf = 0;
+	int ch, rv = 0;
+
+	while ((ch = getopt(argc, argv, "p")) != -1) {
+		switch (ch) {
+		case 'p':
+			perf = 1;
+			break;
+		default:
+			usage(prog);
+		}
+	}
+	argc -= optind - 1;
+	argv += optind - 1;
 
 	switch (argc) {
 	case 1:
@@ -85,12 +109,15 @@ main(int argc, char **argv)
 			break;
 		/* FALLTHROUGH */
 	default:
-		fprintf(stderr, "usage: %s [iter] [c] [s]\n",
-		    basename(argv[0]));
-		return -1;
+		usage(prog);
 	}
 
 	mmcrypt_init(&ctx);
+	if (perf) {
+		if (perf_open(&pc) == 0)
+			warnx("performance counters not available");
+		mmcrypt_set_hook(&ctx, perf_hook, &pc);
+	}
 	rv |= mmcrypt_absorb(&ctx, "pepper", strlen("pepper"));
 	rv |= mmcrypt_absorb(&ctx, "salt", strlen("salt"));
 	rv |= mmcrypt_absorb(&ctx, "tag", strlen("tag"));
@@ -115,6 +142,10 @@ main(int argc, char **argv)
 	    iter, c, s, dump_hex(k2, sizeof(k2)));
 
 	benchmark_result(iter, c, s, &tstart, &tend);
+	if (perf) {
+		perf_report(stdout, &pc, iter, c, s);
+		perf_close(&pc);
+	}
 
 	return 0;
 }
@@ -0,0 +1,99 @@
+/*-
+ * Author: Gleb Kurtsou <gleb@FreeBSD.org>
+ *
+ * This software is hereby placed in the public domain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "mmcrypt-trace.h"
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long trace_seq;
+
+static int
+trace_map(struct mmcrypt_trace *tr)
+{
+	void *win;
+
+	if (ftruncate(tr->fd, tr->winoff + MMCRYPT_TRACE_WINDOW) != 0)
+		return 1;
+	win = mmap(NULL, MMCRYPT_TRACE_WINDOW, PROT_READ | PROT_WRITE,
+	    MAP_SHARED, tr->fd, tr->winoff);
+	if (win == MAP_FAILED)
+		return 1;
+	tr->win = win;
+	tr->pos = 0;
+	return 0;
+}
+
+int
+mmcrypt_trace_open(struct mmcrypt_trace *tr, const char *prefix,
+    const struct mmcrypt_trace_header *hdr)
+{
+	char path[4096];
+	unsigned long seq;
+
+	pthread_mutex_lock(&trace_lock);
+	seq = trace_seq++;
+	pthread_mutex_unlock(&trace_lock);
+	if (snprintf(path, sizeof(path), "%s.%ld.%lu", prefix,
+	    (long)getpid(), seq) >= (int)sizeof(path))
+		return 1;
+	memset(tr, 0, sizeof(*tr));
+	tr->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (tr->fd == -1)
+		return 1;
+	if (trace_map(tr) != 0) {
+		close(tr->fd);
+		return 1;
+	}
+	tr->hdr = *hdr;
+	memcpy(tr->hdr.magic, MMCRYPT_TRACE_MAGIC, sizeof(tr->hdr.magic));
+	tr->hdr.records = 0;
+	tr->pos = sizeof(tr->hdr);
+	return 0;
+}
+
+int
+mmcrypt_trace_advance(struct mmcrypt_trace *tr)
+{
+	if (tr->win == NULL)
+		return 1;
+	munmap(tr->win, MMCRYPT_TRACE_WINDOW);
+	tr->win = NULL;
+	tr->winoff += MMCRYPT_TRACE_WINDOW;
+	return trace_map(tr);
+}
+
+void
+mmcrypt_trace_close(struct mmcrypt_trace *tr)
+{
+	if (tr->win != NULL)
+		munmap(tr->win, MMCRYPT_TRACE_WINDOW);
+	else
+		tr->pos = 0;
+	if (ftruncate(tr->fd, tr->winoff + tr->pos) != 0 ||
+	    pwrite(tr->fd, &tr->hdr, sizeof(tr->hdr), 0) !=
+	    (ssize_t)sizeof(tr->hdr))
+		fprintf(stderr, "mmcrypt: trace write failed\n");
+	close(tr->fd);
+	memset(tr, 0, sizeof(*tr));
+	tr->fd = -1;
+}
@@ -0,0 +1,114 @@
+/*-
+ * Author: Gleb Kurtsou <gleb@FreeBSD.org>
+ *
+ * This software is hereby placed in the public domain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MMCRYPT_TRACE_H_
+#define MMCRYPT_TRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Table access trace of a stretch, produced by a build with
+ * -DMMCRYPT_TRACE (make TRACE=1) when MMCRYPT_TRACE names a file prefix.
+ * Every stretch writes <prefix>.<pid>.<n> and mmcrypt-tracesim replays it
+ * through a cache and TLB model.
+ *
+ * A file is struct mmcrypt_trace_header followed by 64-bit records in
+ * host byte order, one per row access in program order:
+ *
+ *	bits 0-47	row slot within the table, its position in memory
+ *	bits 48-51	table, 0 for T1, 1 for T2
+ *	bits 52-55	enum mmcrypt_phase
+ *	bit  56		write
+ *
+ * Slot n of table t is at base + s * 8 + (t * rows + n) * width, rows
+ * [[i]] map to slots by enum mmcrypt_layout.
+ * Records are stored through a file window mapped MAP_SHARED, advanced
+ * MMCRYPT_TRACE_WINDOW bytes at a time.
+ */
+
+#define MMCRYPT_TRACE_MAGIC	"MMCTRC01"
+#define MMCRYPT_TRACE_WINDOW	(4 << 20)
+
+#define MMCRYPT_TRACE_REC(row, table, phase, write)			\
+	((uint64_t)(row) | (uint64_t)(table) << 48 |			\
+	    (uint64_t)(phase) << 52 | (uint64_t)(write) << 56)
+#define MMCRYPT_TRACE_ROW(rec)		((rec) & ((1ULL << 48) - 1))
+#define MMCRYPT_TRACE_TABLE(rec)	(((rec) >> 48) & 0xf)
+#define MMCRYPT_TRACE_PHASE(rec)	(((rec) >> 52) & 0xf)
+#define MMCRYPT_TRACE_WRITE(rec)	(((rec) >> 56) & 1)
+
+struct mmcrypt_trace_header {
+	char magic[8];
+	uint64_t base;		/* address of table memory */
+	uint64_t rows;		/* rows per table, 2^c * s */
+	uint64_t records;
+	uint32_t iter;
+	uint32_t c;
+	uint32_t s;
+	uint32_t width;		/* row width in bytes */
+	uint32_t rounds;
+	uint32_t layout;		/* enum mmcrypt_layout */
+	uint32_t reserved[2];
+};
+
+struct mmcrypt_trace {
+	int fd;
+	uint8_t *win;
+	uint64_t winoff;
+	size_t pos;
+	struct mmcrypt_trace_header hdr;
+};
+
+/*
+ * Create the next trace file of prefix for a stretch described by hdr
+ * (magic and records are filled in).  Returns 0 on success.
+ */
+int mmcrypt_trace_open(struct mmcrypt_trace *tr, const char *prefix,
+    const struct mmcrypt_trace_header *hdr);
+
+/* Map the next window, returns 0 on success, stops tracing otherwise. */
+int mmcrypt_trace_advance(struct mmcrypt_trace *tr);
+
+/* Truncate the file to the records written and update the header. */
+void mmcrypt_trace_close(struct mmcrypt_trace *tr);
+
+static inline void
+mmcrypt_trace_access(struct mmcrypt_trace *tr, uint64_t row, int table,
+    int phase, int write)
+{
+	uint64_t rec;
+
+	if (tr->pos == MMCRYPT_TRACE_WINDOW && mmcrypt_trace_advance(tr) != 0)
+		return;
+	rec = MMCRYPT_TRACE_REC(row, table, phase, write);
+	memcpy(tr->win + tr->pos, &rec, sizeof(rec));
+	tr->pos += sizeof(rec);
+	tr->hdr.records++;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
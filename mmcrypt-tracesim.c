@@ -0,0 +1,261 @@
+/*-
+ * Author: Gleb Kurtsou <gleb@FreeBSD.org>
+ *
+ * This software is hereby placed in the public domain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Replay stretch table access traces (mmcrypt-trace.h) through a model of
+ * a set-associative cache and a set-associative TLB, both LRU, and report
+ * miss rates per phase.
+ *
+ * Every row access touches all cache lines and pages of the row at its
+ * address in the traced table memory.  Writes allocate like reads.  Page
+ * size selects the TLB model, e.g. -p 2097152 -T 1024 for 2 MiB pages.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <err.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mmcrypt.h"
+#include "mmcrypt-trace.h"
+
+struct sim_cache {
+	uint64_t *tags;		/* sets * ways, most recent first */
+	uint64_t sets;
+	unsigned int ways;
+	unsigned int shift;	/* log2 of line or page size */
+};
+
+struct sim_stats {
+	uint64_t rows;
+	uint64_t lines;
+	uint64_t line_misses;
+	uint64_t pages;
+	uint64_t page_misses;
+};
+
+static unsigned int
+sim_log2(uint64_t v, const char *what)
+{
+	unsigned int n;
+
+	if (v == 0 || (v & (v - 1)) != 0)
+		errx(1, "%s must be a power of 2", what);
+	for (n = 0; (1ULL << n) < v; n++)
+		;
+	return n;
+}
+
+static void
+sim_cache_init(struct sim_cache *sc, uint64_t size, unsigned int ways,
+    uint64_t unit, const char *what)
+{
+	sc->shift = sim_log2(unit, what);
+	if (ways == 0 || size < unit * ways || size % (unit * ways) != 0)
+		errx(1, "%s: size must be a multiple of ways * %ju", what,
+		    (uintmax_t)unit);
+	sc->ways = ways;
+	sc->sets = size / unit / ways;
+	/* Tag 0 is never used, tags are stored as unit number + 1. */
+	sc->tags = calloc(sc->sets * ways, sizeof(sc->tags[0]));
+	if (sc->tags == NULL)
+		err(1, "calloc");
+}
+
+/* LRU lookup and update, returns 1 on a miss. */
+static int
+sim_cache_access(struct sim_cache *sc, uint64_t addr)
+{
+	uint64_t unit, *set;
+	unsigned int i;
+	int miss;
+
+	unit = (addr >> sc->shift) + 1;
+	set = &sc->tags[(unit % sc->sets) * sc->ways];
+	for (i = 0; i < sc->ways && set[i] != unit; i++)
+		;
+	miss = i == sc->ways;
+	if (miss)
+		i = sc->ways - 1;
+	memmove(&set[1], &set[0], i * sizeof(set[0]));
+	set[0] = unit;
+	return miss;
+}
+
+static void
+sim_replay(const char *path, struct sim_cache *cache, struct sim_cache *tlb,
+    struct sim_stats *st, int verbose)
+{
+	const struct mmcrypt_trace_header *hdr;
+	const uint64_t *rec;
+	struct stat sb;
+	uint64_t n, i, rec_i, row, addr, end, a;
+	uint8_t *p;
+	int fd, phase;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+		err(1, "%s", path);
+	if (fstat(fd, &sb) != 0)
+		err(1, "%s", path);
+	if ((size_t)sb.st_size < sizeof(*hdr))
+		errx(1, "%s: not a trace", path);
+	p = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED)
+		err(1, "%s", path);
+	close(fd);
+	hdr = (const struct mmcrypt_trace_header *)p;
+	if (memcmp(hdr->magic, MMCRYPT_TRACE_MAGIC, sizeof(hdr->magic)) != 0)
+		errx(1, "%s: not a trace", path);
+	n = (sb.st_size - sizeof(*hdr)) / sizeof(rec[0]);
+	if (n > hdr->records)
+		n = hdr->records;
+	if (verbose)
+		printf("%s: iter %u c %u s %u width %u rounds %u %s, "
+		    "%ju records\n", path, hdr->iter, hdr->c, hdr->s,
+		    hdr->width, hdr->rounds,
+		    hdr->layout == MMCRYPT_LAYOUT_LANE ? "lane-major" :
+		    "row-major", (uintmax_t)n);
+	rec = (const uint64_t *)(p + sizeof(*hdr));
+	for (i = 0; i < n; i++) {
+		rec_i = rec[i];
+		phase = MMCRYPT_TRACE_PHASE(rec_i);
+		if (phase >= MMCRYPT_PHASE_MAX)
+			errx(1, "%s: record %ju: bad phase", path,
+			    (uintmax_t)i);
+		row = MMCRYPT_TRACE_TABLE(rec_i) * hdr->rows +
+		    MMCRYPT_TRACE_ROW(rec_i);
+		addr = hdr->base + (uint64_t)hdr->s * sizeof(uint64_t) +
+		    row * hdr->width;
+		end = addr + hdr->width;
+		st[phase].rows++;
+		for (a = addr >> cache->shift << cache->shift; a < end;
+		    a += 1ULL << cache->shift) {
+			st[phase].lines++;
+			st[phase].line_misses += sim_cache_access(cache, a);
+		}
+		for (a = addr >> tlb->shift << tlb->shift; a < end;
+		    a += 1ULL << tlb->shift) {
+			st[phase].pages++;
+			st[phase].page_misses += sim_cache_access(tlb, a);
+		}
+	}
+	munmap(p, sb.st_size);
+}
+
+static double
+sim_rate(uint64_t misses, uint64_t total)
+{
+	return total != 0 ? 100.0 * misses / total : 0;
+}
+
+static void
+usage(const char *prog)
+{
+	fprintf(stderr,
+	    "usage: %s [-v] [-C cache-KiB] [-a ways] [-l line-bytes]\n"
+	    "       [-T tlb-entries] [-A tlb-ways] [-p page-bytes] trace ...\n",
+	    prog);
+	exit(-1);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const char *phases[MMCRYPT_PHASE_MAX] = {
+		"stretch", "setup", "fill", "traverse", "wipe",
+	};
+	struct sim_stats st[MMCRYPT_PHASE_MAX], sum;
+	struct sim_cache cache, tlb;
+	const char *prog = basename(argv[0]);
+	uint64_t cache_kib = 32768, line = 64, tlb_entries = 1536;
+	uint64_t page = 4096;
+	unsigned int ways = 16, tlb_ways = 12;
+	int ch, i, verbose = 0;
+
+	while ((ch = getopt(argc, argv, "A:C:T:a:l:p:v")) != -1) {
+		switch (ch) {
+		case 'A':
+			tlb_ways = strtoul(optarg, NULL, 0);
+			break;
+		case 'C':
+			cache_kib = strtoull(optarg, NULL, 0);
+			break;
+		case 'T':
+			tlb_entries = strtoull(optarg, NULL, 0);
+			break;
+		case 'a':
+			ways = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			line = strtoull(optarg, NULL, 0);
+			break;
+		case 'p':
+			page = strtoull(optarg, NULL, 0);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage(prog);
+		}
+	}
+	if (optind == argc)
+		usage(prog);
+
+	sim_cache_init(&cache, cache_kib * 1024, ways, line, "cache");
+	sim_cache_init(&tlb, tlb_entries * page, tlb_ways, page, "tlb");
+	memset(st, 0, sizeof(st));
+	for (i = optind; i < argc; i++)
+		sim_replay(argv[i], &cache, &tlb, st, verbose);
+
+	printf("cache %ju KiB %u-way %ju-byte lines, "
+	    "tlb %ju entries %u-way %ju-byte pages\n",
+	    (uintmax_t)cache_kib, ways, (uintmax_t)line,
+	    (uintmax_t)tlb_entries, tlb_ways, (uintmax_t)page);
+	printf("%-10s %12s %14s %8s %14s %8s\n", "phase", "rows", "lines",
+	    "miss%", "pages", "tlbmiss%");
+	memset(&sum, 0, sizeof(sum));
+	for (i = 0; i < MMCRYPT_PHASE_MAX; i++) {
+		if (st[i].rows == 0)
+			continue;
+		printf("%-10s %12ju %14ju %8.3f %14ju %8.3f\n", phases[i],
+		    (uintmax_t)st[i].rows, (uintmax_t)st[i].lines,
+		    sim_rate(st[i].line_misses, st[i].lines),
+		    (uintmax_t)st[i].pages,
+		    sim_rate(st[i].page_misses, st[i].pages));
+		sum.rows += st[i].rows;
+		sum.lines += st[i].lines;
+		sum.line_misses += st[i].line_misses;
+		sum.pages += st[i].pages;
+		sum.page_misses += st[i].page_misses;
+	}
+	printf("%-10s %12ju %14ju %8.3f %14ju %8.3f\n", "total",
+	    (uintmax_t)sum.rows, (uintmax_t)sum.lines,
+	    sim_rate(sum.line_misses, sum.lines), (uintmax_t)sum.pages,
+	    sim_rate(sum.page_misses, sum.pages));
+	free(cache.tags);
+	free(tlb.tags);
+	return 0;
+}
@@ -0,0 +1,175 @@
+/*-
+ * Author: Gleb Kurtsou <gleb@FreeBSD.org>
+ *
+ * This software is hereby placed in the public domain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mmcrypt-tree.h"
+#include "KeccakNISTInterface.h"
+
+/* Leaves hashed per HashManySuffix() call and at least per thread. */
+#define TREE_BATCH		16
+
+#define TREE_SUFFIX_SINGLE	0x03	/* 11 */
+#define TREE_SUFFIX_LEAF	0x03	/* 110 */
+#define TREE_SUFFIX_FINAL	0x02	/* 01 */
+
+struct tree_work {
+	pthread_t td;
+	const uint8_t *data;
+	size_t datalen;
+	uint8_t *cv;
+	size_t first;
+	size_t count;
+	int rv;
+};
+
+/* Hash leaves first .. first + count - 1, leaf i is chunk i + 1. */
+static int
+tree_leaves(const uint8_t *data, size_t datalen, uint8_t *cv, size_t first,
+    size_t count)
+{
+	const BitSequence *in[TREE_BATCH];
+	BitSequence *out[TREE_BATCH];
+	DataLength bits[TREE_BATCH];
+	size_t i, n, off;
+
+	while (count != 0) {
+		n = count < TREE_BATCH ? count : TREE_BATCH;
+		for (i = 0; i < n; i++) {
+			off = (first + i + 1) * MMCRYPT_TREE_CHUNK;
+			in[i] = data + off;
+			bits[i] = (DataLength)(datalen - off < MMCRYPT_TREE_CHUNK ?
+			    datalen - off : MMCRYPT_TREE_CHUNK) * 8;
+			out[i] = cv + (first + i) * MMCRYPT_TREE_DIGEST;
+		}
+		if (HashManySuffix(MMCRYPT_TREE_DIGEST * 8, in, bits,
+		    TREE_SUFFIX_LEAF, 3, out, n) != SUCCESS)
+			return 1;
+		first += n;
+		count -= n;
+	}
+	return 0;
+}
+
+static void *
+tree_thread_main(void *arg)
+{
+	struct tree_work *w = arg;
+
+	w->rv = tree_leaves(w->data, w->datalen, w->cv, w->first, w->count);
+	return NULL;
+}
+
+/* Hash leaves on up to threads threads, the calling one included. */
+static int
+tree_leaves_parallel(const uint8_t *data, size_t datalen, uint8_t *cv,
+    size_t leaves, int threads)
+{
+	struct tree_work *w;
+	size_t first, per;
+	int i, n, rv;
+
+	if (threads <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	n = (leaves + TREE_BATCH - 1) / TREE_BATCH;
+	if (threads > n)
+		threads = n;
+	if (threads <= 1)
+		return tree_leaves(data, datalen, cv, 0, leaves);
+
+	w = calloc(threads, sizeof(w[0]));
+	if (w == NULL)
+		return 1;
+	per = (leaves + threads - 1) / threads;
+	for (i = 0, first = 0; i < threads; i++, first += per) {
+		w[i].data = data;
+		w[i].datalen = datalen;
+		w[i].cv = cv;
+		w[i].first = first;
+		w[i].count = first < leaves ?
+		    (leaves - first < per ? leaves - first : per) : 0;
+	}
+	for (n = 1; n < threads; n++)
+		if (pthread_create(&w[n].td, NULL, tree_thread_main,
+		    &w[n]) != 0)
+			break;
+	/* Leaves of threads that failed to start run here. */
+	for (i = n; i < threads; i++)
+		w[0].rv |= tree_leaves(data, datalen, cv, w[i].first,
+		    w[i].count);
+	w[0].rv |= tree_leaves(data, datalen, cv, w[0].first, w[0].count);
+	rv = w[0].rv;
+	for (i = 1; i < n; i++) {
+		pthread_join(w[i].td, NULL);
+		rv |= w[i].rv;
+	}
+	free(w);
+	return rv;
+}
+
+int
+mmcrypt_tree_hash(const void *data, size_t datalen,
+    uint8_t digest[MMCRYPT_TREE_DIGEST], int threads)
+{
+	static const uint8_t marker[8] = { 0x03 };
+	static const uint8_t terminator[2] = { 0xff, 0xff };
+	const uint8_t *in = data;
+	uint8_t suffix, enc[sizeof(size_t) + 1], *cv;
+	spongeState ss;
+	size_t leaves, x;
+	int i, n, rv;
+
+	rv = InitSponge(&ss, 576, 1024);
+	if (datalen <= MMCRYPT_TREE_CHUNK) {
+		rv |= Absorb(&ss, in, (unsigned long long)datalen * 8);
+		suffix = TREE_SUFFIX_SINGLE;
+		rv |= Absorb(&ss, &suffix, 2);
+		rv |= Squeeze(&ss, digest, MMCRYPT_TREE_DIGEST * 8);
+		memset(&ss, 0, sizeof(ss));
+		return !!rv;
+	}
+
+	leaves = (datalen - 1) / MMCRYPT_TREE_CHUNK;
+	cv = malloc(leaves * MMCRYPT_TREE_DIGEST);
+	if (cv == NULL)
+		return 1;
+	rv |= tree_leaves_parallel(in, datalen, cv, leaves, threads);
+
+	rv |= Absorb(&ss, in, MMCRYPT_TREE_CHUNK * 8);
+	rv |= Absorb(&ss, marker, sizeof(marker) * 8);
+	rv |= Absorb(&ss, cv, (unsigned long long)leaves *
+	    MMCRYPT_TREE_DIGEST * 8);
+	for (x = leaves, n = 0; x != 0; x >>= 8)
+		n++;
+	for (i = 0, x = leaves; i < n; i++, x >>= 8)
+		enc[n - 1 - i] = x & 0xff;
+	enc[n] = n;
+	rv |= Absorb(&ss, enc, (n + 1) * 8);
+	rv |= Absorb(&ss, terminator, sizeof(terminator) * 8);
+	suffix = TREE_SUFFIX_FINAL;
+	rv |= Absorb(&ss, &suffix, 2);
+	rv |= Squeeze(&ss, digest, MMCRYPT_TREE_DIGEST * 8);
+	memset(&ss, 0, sizeof(ss));
+	memset(cv, 0, leaves * MMCRYPT_TREE_DIGEST);
+	free(cv);
+	return !!rv;
+}
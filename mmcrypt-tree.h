@@ -0,0 +1,68 @@
+/*-
+ * Author: Gleb Kurtsou <gleb@FreeBSD.org>
+ *
+ * This software is hereby placed in the public domain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MMCRYPT_TREE_H_
+#define MMCRYPT_TREE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Parallel tree hash in the style of KangarooTwelve, with Keccak[r=576,
+ * c=1024] (24 rounds) in every node and 512-bit output.
+ *
+ * Input S is cut into 8 KiB chunks S_0 .. S_{n-1}.  For n = 1 the hash is
+ * that of S followed by suffix bits 11.  Otherwise chunks S_1 .. S_{n-1}
+ * are leaves, hashed independently with suffix bits 110 into 512-bit
+ * chaining values CV_i, and the hash is that of the final node
+ *
+ *	S_0 || 03 00^7 || CV_1 || ... || CV_{n-1} || length_encode(n-1) ||
+ *	FF FF
+ *
+ * followed by suffix bits 01.  length_encode(x) is x in big-endian bytes,
+ * no leading zeroes, followed by the number of those bytes.
+ *
+ * Leaves are spread over up to 'threads' threads (0: online CPUs), every
+ * thread hashes its leaves with HashManySuffix() in SIMD lanes.
+ */
+
+/* Exported from libmmcrypt.so, see mmcrypt.h. */
+#if defined(__GNUC__)
+#pragma GCC visibility push(default)
+#endif
+
+#define MMCRYPT_TREE_CHUNK	8192
+#define MMCRYPT_TREE_DIGEST	64
+
+/* Returns 0 on success, 1 if memory or threads can't be allocated. */
+int mmcrypt_tree_hash(const void *data, size_t datalen,
+    uint8_t digest[MMCRYPT_TREE_DIGEST], int threads);
+
+#if defined(__GNUC__)
+#pragma GCC visibility pop
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
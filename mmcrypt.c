@@ -24,13 +24,68 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(__linux__) && defined(__has_include) && !defined(MMCRYPT_NO_SDT)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define MMCRYPT_SDT
+#endif
+#endif
 
 #include "mmcrypt.h"
+#include "mmcrypt-numa.h"
+#include "mmcrypt-tree.h"
+#ifdef MMCRYPT_TRACE
+#include "mmcrypt-trace.h"
+#endif
 
 #define L_BITS			(512)
 #define L_BYTES			(L_BITS / 8)
 #define L_QUADS			(L_BYTES / 8)
 
+#define DIGEST_BITS		(512)
+#define DIGEST_BYTES		(DIGEST_BITS / 8)
+
+#define MMCRYPT_HOOK(ctx, phase, end) do {				\
+	if ((ctx)->hook != NULL)					\
+		(ctx)->hook((ctx)->hook_arg, (phase), (end));		\
+} while (0)
+
+/* Row accesses of the stretch running on this thread, see mmcrypt-trace.h. */
+#ifdef MMCRYPT_TRACE
+static __thread struct mmcrypt_trace *mmcrypt_tr;
+
+#define MMCRYPT_TRACE_ACCESS(row, table, phase, write) do {		\
+	if (mmcrypt_tr != NULL)						\
+		mmcrypt_trace_access(mmcrypt_tr, (row), (table),	\
+		    (phase), (write));					\
+} while (0)
+#else
+#define MMCRYPT_TRACE_ACCESS(row, table, phase, write) do { } while (0)
+#endif
+
+/*
+ * USDT probes of provider mmcrypt, a nop each unless traced.  Compiled out
+ * without <sys/sdt.h> or with -DMMCRYPT_NO_SDT.  Arguments:
+ *	stretch__start, stretch__done	iter, c, s
+ *	fill__start, traverse__start	pass, c, s
+ *	fill__done			pass, c, s, rows filled
+ *	traverse__done			pass, c, s, steps taken
+ *	feedback			c, s, feedback duplexes this pass
+ *	wipe__start, wipe__done		bytes of table memory
+ */
+#ifdef MMCRYPT_SDT
+#define MMCRYPT_PROBE1(name, a)		DTRACE_PROBE1(mmcrypt, name, a)
+#define MMCRYPT_PROBE3(name, a, b, c)	DTRACE_PROBE3(mmcrypt, name, a, b, c)
+#define MMCRYPT_PROBE4(name, a, b, c, d)				\
+	DTRACE_PROBE4(mmcrypt, name, a, b, c, d)
+#else
+#define MMCRYPT_PROBE1(name, a)		do { (void)(a); } while (0)
+#define MMCRYPT_PROBE3(name, a, b, c)					\
+	do { (void)(a); (void)(b); (void)(c); } while (0)
+#define MMCRYPT_PROBE4(name, a, b, c, d)				\
+	do { (void)(a); (void)(b); (void)(c); (void)(d); } while (0)
+#endif
+
 #define GF_POL1(n, p1) \
 	(1ULL | (1ULL << p1))
 #define GF_POL3(n, p1, p2, p3) \
@@ -80,35 +135,174 @@ mmcrypt_init(struct mmcrypt_ctx *ctx)
 {
 	int rv;
 
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->node = -1;
 	rv = InitDuplex(&ctx->sm, 576, 1024);
 	if (rv != 0)
 		abort();
 }
 
+void
+mmcrypt_set_hook(struct mmcrypt_ctx *ctx, mmcrypt_hook_t *hook, void *arg)
+{
+	ctx->hook = hook;
+	ctx->hook_arg = arg;
+}
+
+void
+mmcrypt_set_mempolicy(struct mmcrypt_ctx *ctx, enum mmcrypt_mempolicy policy)
+{
+	ctx->mempolicy = policy;
+}
+
+void
+mmcrypt_set_layout(struct mmcrypt_ctx *ctx, enum mmcrypt_layout layout)
+{
+	ctx->layout = layout;
+}
+
+int
+mmcrypt_table_node(const struct mmcrypt_ctx *ctx)
+{
+	return ctx->node;
+}
+
 void
 mmcrypt_destroy(struct mmcrypt_ctx *ctx)
 {
 	memset(ctx, 0, sizeof(*ctx));
 }
 
+void
+mmcrypt_ctx_clone(struct mmcrypt_ctx *dst, const struct mmcrypt_ctx *src)
+{
+	if (dst != src)
+		memcpy(dst, src, sizeof(*dst));
+}
+
 int
 mmcrypt_absorb(struct mmcrypt_ctx *ctx, const void *data, size_t datalen)
 {
 	int rv;
 
+	if (ctx->streaming)
+		return 1;
 	rv = Duplexing(&ctx->sm, data, datalen * 8, NULL, 0);
 	return !!rv;
 }
 
+int
+mmcrypt_absorb_begin(struct mmcrypt_ctx *ctx)
+{
+	int rv;
+
+	if (ctx->streaming)
+		return 1;
+	rv = InitSponge(&ctx->ss, 576, 1024);
+	if (rv != 0)
+		return 1;
+	ctx->streaming = 1;
+	return 0;
+}
+
+int
+mmcrypt_absorb_update(struct mmcrypt_ctx *ctx, const void *data,
+    size_t datalen)
+{
+	int rv;
+
+	if (!ctx->streaming)
+		return 1;
+	rv = Absorb(&ctx->ss, data, (unsigned long long)datalen * 8);
+	return !!rv;
+}
+
+int
+mmcrypt_absorb_final(struct mmcrypt_ctx *ctx)
+{
+	uint8_t digest[DIGEST_BYTES + 1];
+	int rv;
+
+	if (!ctx->streaming)
+		return 1;
+	rv = Squeeze(&ctx->ss, digest, DIGEST_BITS);
+	digest[DIGEST_BYTES] = 0x01;
+	if (rv == 0)
+		rv = Duplexing(&ctx->sm, digest, DIGEST_BITS + 1, NULL, 0);
+	memset(digest, 0, sizeof(digest));
+	memset(&ctx->ss, 0, sizeof(ctx->ss));
+	ctx->streaming = 0;
+	return !!rv;
+}
+
+int
+mmcrypt_absorb_tree(struct mmcrypt_ctx *ctx, const void *data, size_t datalen,
+    int threads)
+{
+	uint8_t digest[DIGEST_BYTES + 1];
+	int rv;
+
+	if (ctx->streaming)
+		return 1;
+	rv = mmcrypt_tree_hash(data, datalen, digest, threads);
+	/* Bits 0 and 1 after the digest, 514 bits in total. */
+	digest[DIGEST_BYTES] = 0x02;
+	if (rv == 0)
+		rv = Duplexing(&ctx->sm, digest, DIGEST_BITS + 2, NULL, 0);
+	memset(digest, 0, sizeof(digest));
+	return !!rv;
+}
+
 int
 mmcrypt_squeeze(struct mmcrypt_ctx *ctx, void *key, size_t keylen)
 {
 	int rv;
 
+	if (ctx->streaming)
+		return 1;
 	rv = Duplexing(&ctx->sm, NULL, 0, key, keylen * 8);
 	return !!rv;
 }
 
+int
+mmcrypt_squeeze_long(struct mmcrypt_ctx *ctx, void *key, size_t keylen)
+{
+	int rv;
+
+	if (ctx->streaming)
+		return 1;
+	rv = DuplexingSqueeze(&ctx->sm, key, (unsigned long long)keylen * 8);
+	return !!rv;
+}
+
+int
+mmcrypt_derive(const struct mmcrypt_ctx *ctx, const char *label,
+    void *key, size_t keylen)
+{
+	uint8_t in[MMCRYPT_LABEL_MAX + 1];
+	duplexState sm;
+	size_t len;
+	int rv;
+
+	len = strlen(label);
+	if (ctx->streaming || len == 0 || len > MMCRYPT_LABEL_MAX)
+		return 1;
+	/*
+	 * Bits 1 and 1 after the label: 8 * len + 2 bits, a length neither
+	 * mmcrypt_absorb() (whole bytes) nor the absorb digests (513 and 514
+	 * bits with other tails) produce.
+	 */
+	memcpy(in, label, len);
+	in[len] = 0x03;
+	sm = ctx->sm;
+	rv = Duplexing(&sm, in, len * 8 + 2, NULL, 0);
+	if (rv == 0)
+		rv = DuplexingSqueeze(&sm, key, (unsigned long long)keylen * 8);
+	memset(in, 0, sizeof(in));
+	memset(&sm, 0, sizeof(sm));
+	return !!rv;
+}
+
 static inline uint64_t
 mmcrypt_gfmul(uint64_t x, uint64_t pol, uint64_t msb1)
 {
@@ -135,89 +329,311 @@ mmcrypt_gfmul_512(uint64_t *x)
 	x[7] = (x[7] << 1) ^ ((-msb) & gf_512_pol);
 }
 
+/* Row index from the last quad of row x of rq quads. */
 static inline uint32_t
-mmcrypt_wrap(uint64_t *x, uint32_t i, uint32_t imask)
+mmcrypt_wrap(uint64_t *x, uint32_t rq, uint32_t i, uint32_t imask)
 {
 	uint64_t a;
 	uint32_t w;
 
-	a = be64toh(x[L_QUADS - 1]);
+	a = be64toh(x[rq - 1]);
 	w = a & imask;
 	w += i - imask - 1;
 	return w;
 }
 
+/*
+ * Mix rows of rq quads, 512-bit blocks b: feedback takes the XOR of all
+ * x1[b] ^ x2[b], every y[b] pair takes (x1[b] ^ x2[b]) * alpha.  Rows y
+ * may be x (s = 1), block b is read before it is written.
+ */
 static inline void
-mmcrypt_mix(uint64_t *feedback, uint64_t xmask,
+mmcrypt_mix(uint64_t *feedback, uint64_t xmask, uint32_t rq,
     uint64_t *x1, uint64_t *x2,
     uint64_t *y1, uint64_t *y2)
 {
 	uint64_t x[L_QUADS];
 	uint64_t xswap, xskip;
 	uint64_t t;
-	uint32_t j;
+	uint32_t b, j;
 
 	xskip = (x1[0] ^ x2[0]) & xmask;
 	xskip = -!!(int64_t)(xskip & xmask);
-	for (j = 0; j < L_QUADS; j++) {
-		x[j] = x1[j] ^ x2[j];
-		feedback[j] ^= x[j] & xskip;
-	}
+	for (b = 0; b < rq; b += L_QUADS)
+		for (j = 0; j < L_QUADS; j++)
+			feedback[j] ^= (x1[b + j] ^ x2[b + j]) & xskip;
 	mmcrypt_gfmul_512(feedback);
 	xswap = -(int64_t)(((uint8_t *)feedback)[0] >> 7);
 
-	mmcrypt_gfmul_512(x);
-	for (j = 0; j < L_QUADS; j++) {
-		t = (y1[j] ^ y2[j] ^ x[j]) & xswap;
-		y1[j] ^= t;
-		y2[j] ^= t;
+	for (b = 0; b < rq; b += L_QUADS) {
+		for (j = 0; j < L_QUADS; j++)
+			x[j] = x1[b + j] ^ x2[b + j];
+		mmcrypt_gfmul_512(x);
+		for (j = 0; j < L_QUADS; j++) {
+			t = (y1[b + j] ^ y2[b + j] ^ x[j]) & xswap;
+			y1[b + j] ^= t;
+			y2[b + j] ^= t;
+		}
 	}
 }
 
+/*
+ * Traversal kernel.  Profiles listed in MMCRYPT_TRAVERSE_PROFILES get a
+ * copy of the kernel with c and s known at compile time: the GF(2^2c)
+ * polynomial and masks become constants and row offsets are computed
+ * without division.  Profiles use the default 512-bit rows, other
+ * parameters use the generic kernel.
+ * Override the list with e.g. -DMMCRYPT_TRAVERSE_PROFILES="X(7, 337) X(8, 64)".
+ */
+#ifndef MMCRYPT_TRAVERSE_PROFILES
+#define MMCRYPT_TRAVERSE_PROFILES					\
+	X(7, 337)
+#endif
+
+#if defined(__GNUC__)
+#define MMCRYPT_ALWAYS_INLINE	inline __attribute__((always_inline))
+#else
+#define MMCRYPT_ALWAYS_INLINE	inline
+#endif
+
+/*
+ * Row [[ka * s + i]] of a table is at ka * ks + i * ls quads, ks = s * rq
+ * and ls = rq row-major, ks = rq and ls = 2^c * rq lane-major.
+ */
+static MMCRYPT_ALWAYS_INLINE void
+mmcrypt_traverse_kernel(struct mmcrypt_ctx *ctx, uint64_t *k,
+    uint64_t *t1, uint64_t *t2, uint64_t *feedback, uint64_t xmask,
+    const uint32_t c, const uint32_t s, const uint32_t rq,
+    const size_t ks, const size_t ls)
+{
+	const uint64_t kpol = mmcrypt_gfpol[c];
+	const uint64_t kmsb1 = 1ULL << (c * 2);
+	const uint32_t kmask = (1 << c) - 1;
+	uint64_t k0;
+	uint64_t *x1, *x2, *y1, *y2;
+	uint32_t feedback_count, nfeedback;
+	uint32_t i, ka, kb;
+
+	feedback_count = 0;
+	nfeedback = 0;
+	k0 = k[0];
+	do {
+		for (i = 0; i < s; i++) {
+			k[i] = mmcrypt_gfmul(k[i], kpol, kmsb1);
+			ka = (k[i] >> c) & kmask;
+			kb = k[i] & kmask;
+			x1 = &t1[(size_t)ka * ks + (size_t)i * ls];
+			x2 = &t2[(size_t)kb * ks + (size_t)i * ls];
+			/* Next column of the same rows, wraps within the row */
+			if (i + 1 < s) {
+				y1 = x1 + ls;
+				y2 = x2 + ls;
+			} else {
+				y1 = x1 - (size_t)i * ls;
+				y2 = x2 - (size_t)i * ls;
+			}
+			MMCRYPT_TRACE_ACCESS((x1 - t1) / rq, 0,
+			    MMCRYPT_PHASE_TRAVERSE, 0);
+			MMCRYPT_TRACE_ACCESS((x2 - t2) / rq, 1,
+			    MMCRYPT_PHASE_TRAVERSE, 0);
+			/* y rows are read and written whatever the swap */
+			MMCRYPT_TRACE_ACCESS((y1 - t1) / rq, 0,
+			    MMCRYPT_PHASE_TRAVERSE, 1);
+			MMCRYPT_TRACE_ACCESS((y2 - t2) / rq, 1,
+			    MMCRYPT_PHASE_TRAVERSE, 1);
+			mmcrypt_mix(feedback, xmask, rq, x1, x2, y1, y2);
+			if (++feedback_count == MMCRYPT_FEEDBACK_RATE) {
+				feedback_count = 0;
+				MMCRYPT_PROBE3(feedback, c, s, ++nfeedback);
+				Duplexing(&ctx->sm,
+				    (uint8_t *)feedback, L_BITS,
+				    (uint8_t *)feedback, L_BITS);
+			}
+		}
+	} while (k0 != k[0]);
+}
+
+#define X(c, s)								\
+static void								\
+mmcrypt_traverse_##c##_##s(struct mmcrypt_ctx *ctx, uint64_t *k,	\
+    uint64_t *t1, uint64_t *t2, uint64_t *feedback, uint64_t xmask,	\
+    int lane)								\
+{									\
+	if (lane)							\
+		mmcrypt_traverse_kernel(ctx, k, t1, t2, feedback, xmask,\
+		    c, s, L_QUADS, L_QUADS, (size_t)L_QUADS << (c));	\
+	else								\
+		mmcrypt_traverse_kernel(ctx, k, t1, t2, feedback, xmask,\
+		    c, s, L_QUADS, (size_t)(s) * L_QUADS, L_QUADS);	\
+}
+MMCRYPT_TRAVERSE_PROFILES
+#undef X
+
+static void
+mmcrypt_traverse(struct mmcrypt_ctx *ctx, uint64_t *k,
+    uint64_t *t1, uint64_t *t2, uint64_t *feedback, uint64_t xmask,
+    uint32_t c, uint32_t s, uint32_t rq, int lane)
+{
+#define X(pc, ps)							\
+	if (c == (pc) && s == (ps) && rq == L_QUADS) {			\
+		mmcrypt_traverse_##pc##_##ps(ctx, k, t1, t2, feedback, xmask, \
+		    lane);						\
+		return;							\
+	}
+	MMCRYPT_TRAVERSE_PROFILES
+#undef X
+	if (lane)
+		mmcrypt_traverse_kernel(ctx, k, t1, t2, feedback, xmask, c, s,
+		    rq, rq, (size_t)rq << c);
+	else
+		mmcrypt_traverse_kernel(ctx, k, t1, t2, feedback, xmask, c, s,
+		    rq, (size_t)s * rq, rq);
+}
+
+/* Row [[r]] of a table in the given layout, see mmcrypt_traverse_kernel(). */
+static inline uint64_t *
+mmcrypt_row(uint64_t *t, size_t r, uint32_t c, uint32_t s, uint32_t rq,
+    int lane)
+{
+	if (lane)
+		r = ((r % s) << c) + r / s;
+	return t + r * rq;
+}
+
+/* Row width in bytes, 0 if invalid. */
+static size_t
+mmcrypt_width(const struct mmcrypt_params *p)
+{
+	if (p->width == 0)
+		return L_BYTES;
+	if (p->width < MMCRYPT_WIDTH_MIN || p->width > MMCRYPT_WIDTH_MAX ||
+	    (p->width & (p->width - 1)) != 0)
+		return 0;
+	return p->width;
+}
+
+size_t
+mmcrypt_memsize(const struct mmcrypt_params *p)
+{
+	size_t rows, width;
+
+	if (p->iter < 1 || p->c < 1 || p->c > 31 || p->s < 1)
+		return 0;
+	if (p->rounds != 0 && p->rounds != MMCRYPT_ROUNDS_FULL &&
+	    p->rounds != MMCRYPT_ROUNDS_REDUCED)
+		return 0;
+	width = mmcrypt_width(p);
+	if (width == 0)
+		return 0;
+	/* k[s] followed by T1 and T2 of 2^c * s rows each */
+	if (p->s > SIZE_MAX / 2 / width >> p->c)
+		return 0;
+	rows = ((size_t)p->s << p->c) * 2;
+	if (rows * width > SIZE_MAX - p->s * sizeof(uint64_t))
+		return 0;
+	return p->s * sizeof(uint64_t) + rows * width;
+}
+
 int
 mmcrypt_stretch(struct mmcrypt_ctx *ctx, uint32_t iter, uint32_t c, uint32_t s)
+{
+	const struct mmcrypt_params p = { .iter = iter, .c = c, .s = s };
+
+	return mmcrypt_stretch_params(ctx, &p);
+}
+
+int
+mmcrypt_stretch_params(struct mmcrypt_ctx *ctx, const struct mmcrypt_params *p)
+{
+	void *mem;
+	size_t memlen;
+	int rv;
+
+	memlen = mmcrypt_memsize(p);
+	if (memlen == 0)
+		return 1;
+	mem = mmcrypt_numa_alloc(memlen, ctx->mempolicy);
+	if (mem == NULL)
+		return 1;
+	rv = mmcrypt_stretch_mem(ctx, p, mem, memlen);
+	mmcrypt_numa_free(mem, memlen);
+	return rv;
+}
+
+int
+mmcrypt_stretch_mem(struct mmcrypt_ctx *ctx, const struct mmcrypt_params *p,
+    void *mem, size_t memlen)
 {
 	duplexState s1, s2, st;
 	uint64_t feedback[L_QUADS];
 	uint64_t x[L_QUADS];
-	uint64_t *k, *t1, *t2, *x1, *x2;
+	uint64_t *k, *t1, *t2, *x1, *x2, *y1, *y2, *p1, *p2;
 	uint64_t xmask;
-	uint64_t k0, kpol, kmsb1;
-	size_t nsbytes;
-	uint32_t kmask, ka, kb;
-	uint32_t feedback_count;
-	uint32_t i, imask, n, rv;
+	size_t nsbytes, r, rows;
+	uint32_t iter, c, s, rounds, width, rq;
+	uint32_t ka, kb;
+	uint32_t b, i, imask, rv;
+	int lane;
+#ifdef MMCRYPT_TRACE
+	struct mmcrypt_trace tr;
+	struct mmcrypt_trace_header trh;
+	const char *trprefix;
+#endif
 
-	if (iter < 1 || c < 1 || c > 31 || s < 1)
+	if (ctx->streaming || mmcrypt_memsize(p) == 0 ||
+	    memlen < mmcrypt_memsize(p) || (uintptr_t)mem % sizeof(k[0]) != 0)
 		return 1;
-	n = 1 << c;
-	if ((uint64_t)n * s * L_BYTES * 2 + s * sizeof(k[0]) >= SIZE_MAX)
-		return 1;
-	nsbytes = n * s * L_BYTES;
-	rv  = InitDuplex(&s1, 576, 1024);
-	rv |= InitDuplex(&s2, 576, 1024);
+	iter = p->iter;
+	c = p->c;
+	s = p->s;
+	/* Default Keccak-f rounds are encoded as 0, keeping keys unchanged. */
+	rounds = p->rounds == MMCRYPT_ROUNDS_FULL ? 0 : p->rounds;
+	/* The same for the default row width. */
+	width = mmcrypt_width(p);
+	rq = width / sizeof(k[0]);
+	if (width == L_BYTES)
+		width = 0;
+	rows = (size_t)s << c;
+	nsbytes = rows * rq * sizeof(k[0]);
+	lane = ctx->layout == MMCRYPT_LAYOUT_LANE;
+	rv  = InitDuplexRounds(&s1, 576, 1024,
+	    rounds != 0 ? rounds : MMCRYPT_ROUNDS_FULL);
+	rv |= InitDuplexRounds(&s2, 576, 1024,
+	    rounds != 0 ? rounds : MMCRYPT_ROUNDS_FULL);
 	if (rv != 0)
 		return 1;
-	k = malloc(s * sizeof(k[0]) + nsbytes * 2);
-	if (k == NULL)
-		return 1;
+	k = mem;
+#ifdef MMCRYPT_TRACE
+	trprefix = getenv("MMCRYPT_TRACE");
+	memset(&trh, 0, sizeof(trh));
+	trh.base = (uintptr_t)mem;
+	trh.rows = rows;
+	trh.iter = iter;
+	trh.c = c;
+	trh.s = s;
+	trh.width = rq * sizeof(k[0]);
+	trh.rounds = rounds != 0 ? rounds : MMCRYPT_ROUNDS_FULL;
+	trh.layout = ctx->layout;
+	if (trprefix != NULL && mmcrypt_trace_open(&tr, trprefix, &trh) == 0)
+		mmcrypt_tr = &tr;
+#endif
+	MMCRYPT_PROBE3(stretch__start, iter, c, s);
+	MMCRYPT_HOOK(ctx, MMCRYPT_PHASE_STRETCH, 0);
 	t1 = &k[s];
 	t2 = &t1[nsbytes / sizeof(t1[0])];
 	memset(feedback, 0, sizeof(feedback));
-	kpol = mmcrypt_gfpol[c];
-	kmsb1 = 1ULL << (c * 2);
-	kmask = (1 << c) - 1;
 	xmask = htobe64(((uint64_t)-1ULL) << (64 - c));
 	x[0] = htobe64(MMCRYPT_FEEDBACK_RATE);
 	x[1] = htobe64(iter);
 	x[2] = htobe64(c);
 	x[3] = htobe64(s);
-	x[4] = htobe64(0);
-	x[5] = htobe64(0);
+	x[4] = htobe64(rounds);
+	x[5] = htobe64(width);
 	x[6] = htobe64(0);
 	x[7] = htobe64(0);
 	Duplexing(&ctx->sm, (uint8_t *)x, L_BITS, NULL, 0);
 	for (; iter > 0; iter--) {
+		MMCRYPT_HOOK(ctx, MMCRYPT_PHASE_SETUP, 0);
 		Duplexing(&ctx->sm, NULL, 0, (uint8_t *)x, L_BITS);
 		Duplexing(&s1, (uint8_t *)x, L_BITS, NULL, 0);
 		Duplexing(&ctx->sm, NULL, 0, (uint8_t *)x, L_BITS);
@@ -228,49 +644,80 @@ mmcrypt_stretch(struct mmcrypt_ctx *ctx, uint32_t iter, uint32_t c, uint32_t s)
 			k[i] = k[i] >> (64 - c * 2);
 			k[i] |= 1;
 		}
-		feedback_count = 0;
-		Duplexing(&s1, NULL, 0, (uint8_t *)t1, L_BITS);
-		Duplexing(&s2, NULL, 0, (uint8_t *)t2, L_BITS);
-		for (i = 1, imask = 0, x1 = t1 + L_QUADS, x2 = t2 + L_QUADS;
-		    x1 < t2; x1 += L_QUADS, x2 += L_QUADS, i++) {
-			imask |= i >> 1;
-			ka = mmcrypt_wrap(x2 - L_QUADS, i, imask);
-			kb = mmcrypt_wrap(x1 - L_QUADS, i, imask);
-			Duplexing(&s1, (uint8_t *)(t2 + ka * L_QUADS), L_BITS,
-			    (uint8_t *)x1, L_BITS);
-			Duplexing(&s2, (uint8_t *)(t1 + kb * L_QUADS), L_BITS,
-			    (uint8_t *)x2, L_BITS);
+		MMCRYPT_HOOK(ctx, MMCRYPT_PHASE_SETUP, 1);
+		MMCRYPT_PROBE3(fill__start, p->iter - iter, c, s);
+		MMCRYPT_HOOK(ctx, MMCRYPT_PHASE_FILL, 0);
+		/*
+		 * Rows are squeezed block by block, block b from block b,
+		 * in order of [[r]] whatever the layout.
+		 */
+		MMCRYPT_TRACE_ACCESS(0, 0, MMCRYPT_PHASE_FILL, 1);
+		MMCRYPT_TRACE_ACCESS(0, 1, MMCRYPT_PHASE_FILL, 1);
+		for (b = 0; b < rq; b += L_QUADS) {
+			Duplexing(&s1, NULL, 0, (uint8_t *)(t1 + b), L_BITS);
+			Duplexing(&s2, NULL, 0, (uint8_t *)(t2 + b), L_BITS);
 		}
-		k0 = k[0];
-		do {
-			for (i = 0; i < s; i++) {
-				k[i] = mmcrypt_gfmul(k[i], kpol, kmsb1);
-				ka = (k[i] >> c) & kmask;
-				kb = k[i] & kmask;
-				mmcrypt_mix(feedback, xmask,
-				    &t1[(ka * s + i) * L_QUADS],
-				    &t2[(kb * s + i) * L_QUADS],
-				    &t1[(ka * s + (i + 1) % s) * L_QUADS],
-				    &t2[(kb * s + (i + 1) % s) * L_QUADS]);
-				if (++feedback_count == MMCRYPT_FEEDBACK_RATE) {
-					feedback_count = 0;
-					Duplexing(&ctx->sm,
-					    (uint8_t *)feedback, L_BITS,
-					    (uint8_t *)feedback, L_BITS);
-				}
+		for (r = 1, imask = 0, p1 = t1, p2 = t2; r < rows;
+		    r++, p1 = x1, p2 = x2) {
+			i = r;
+			imask |= i >> 1;
+			ka = mmcrypt_wrap(p2, rq, i, imask);
+			kb = mmcrypt_wrap(p1, rq, i, imask);
+			x1 = mmcrypt_row(t1, r, c, s, rq, lane);
+			x2 = mmcrypt_row(t2, r, c, s, rq, lane);
+			y1 = mmcrypt_row(t1, kb, c, s, rq, lane);
+			y2 = mmcrypt_row(t2, ka, c, s, rq, lane);
+			MMCRYPT_TRACE_ACCESS((p2 - t2) / rq, 1,
+			    MMCRYPT_PHASE_FILL, 0);
+			MMCRYPT_TRACE_ACCESS((p1 - t1) / rq, 0,
+			    MMCRYPT_PHASE_FILL, 0);
+			MMCRYPT_TRACE_ACCESS((y2 - t2) / rq, 1,
+			    MMCRYPT_PHASE_FILL, 0);
+			MMCRYPT_TRACE_ACCESS((x1 - t1) / rq, 0,
+			    MMCRYPT_PHASE_FILL, 1);
+			MMCRYPT_TRACE_ACCESS((y1 - t1) / rq, 0,
+			    MMCRYPT_PHASE_FILL, 0);
+			MMCRYPT_TRACE_ACCESS((x2 - t2) / rq, 1,
+			    MMCRYPT_PHASE_FILL, 1);
+			for (b = 0; b < rq; b += L_QUADS) {
+				Duplexing(&s1, (uint8_t *)(y2 + b), L_BITS,
+				    (uint8_t *)(x1 + b), L_BITS);
+				Duplexing(&s2, (uint8_t *)(y1 + b), L_BITS,
+				    (uint8_t *)(x2 + b), L_BITS);
 			}
-		} while (k0 != k[0]);
+		}
+		MMCRYPT_HOOK(ctx, MMCRYPT_PHASE_FILL, 1);
+		MMCRYPT_PROBE4(fill__done, p->iter - iter, c, s,
+		    ((uint64_t)s << c) * 2);
+		MMCRYPT_PROBE3(traverse__start, p->iter - iter, c, s);
+		MMCRYPT_HOOK(ctx, MMCRYPT_PHASE_TRAVERSE, 0);
+		mmcrypt_traverse(ctx, k, t1, t2, feedback, xmask, c, s, rq, lane);
+		MMCRYPT_HOOK(ctx, MMCRYPT_PHASE_TRAVERSE, 1);
+		MMCRYPT_PROBE4(traverse__done, p->iter - iter, c, s,
+		    ((1ULL << (2 * c)) - 1) * s);
 		Duplexing(&ctx->sm, (uint8_t *)feedback, L_BITS, NULL, 0);
 		st = s1;
 		s1 = s2;
 		s2 = st;
 	}
+	MMCRYPT_PROBE1(wipe__start, s * sizeof(k[0]) + nsbytes * 2);
+	MMCRYPT_HOOK(ctx, MMCRYPT_PHASE_WIPE, 0);
 	// TODO Use memset_s if available
 	memset(k, 0, s * sizeof(k[0]) + nsbytes * 2);
-	free(k);
 	memset(x, 0, sizeof(x));
 	memset(feedback, 0, sizeof(feedback));
 	memset(&s1, 0, sizeof(s1));
 	memset(&s2, 0, sizeof(s2));
+	MMCRYPT_HOOK(ctx, MMCRYPT_PHASE_WIPE, 1);
+	ctx->node = mmcrypt_numa_node_of(mem);
+	MMCRYPT_PROBE1(wipe__done, s * sizeof(k[0]) + nsbytes * 2);
+	MMCRYPT_HOOK(ctx, MMCRYPT_PHASE_STRETCH, 1);
+	MMCRYPT_PROBE3(stretch__done, p->iter, c, s);
+#ifdef MMCRYPT_TRACE
+	if (mmcrypt_tr != NULL) {
+		mmcrypt_trace_close(mmcrypt_tr);
+		mmcrypt_tr = NULL;
+	}
+#endif
 	return 0;
 }
@@ -21,21 +21,188 @@
 
 #define MMCRYPT_FEEDBACK_RATE	65521
 
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #include "KeccakNISTInterface.h"
 #include "KeccakDuplex.h"
 
+/* Public API, exported from libmmcrypt.so built with -fvisibility=hidden. */
+#if defined(__GNUC__)
+#pragma GCC visibility push(default)
+#endif
+
+/*
+ * Phases of mmcrypt_stretch(), reported to an optional per context hook.
+ * SETUP, FILL, TRAVERSE are entered once per iteration, STRETCH and WIPE
+ * once per call.
+ */
+enum mmcrypt_phase {
+	MMCRYPT_PHASE_STRETCH = 0,
+	MMCRYPT_PHASE_SETUP,
+	MMCRYPT_PHASE_FILL,
+	MMCRYPT_PHASE_TRAVERSE,
+	MMCRYPT_PHASE_WIPE,
+	MMCRYPT_PHASE_MAX
+};
+
+typedef void mmcrypt_hook_t(void *arg, enum mmcrypt_phase phase, int end);
+
+/* NUMA placement of tables allocated by mmcrypt_stretch(). */
+enum mmcrypt_mempolicy {
+	MMCRYPT_MEM_LOCAL = 0,		/* node of the calling thread */
+	MMCRYPT_MEM_INTERLEAVE,		/* pages spread over all nodes */
+	MMCRYPT_MEM_DEFAULT,		/* system default */
+};
+
+/*
+ * Order of rows [[ka * s + i]] in table memory, keys do not depend on it.
+ * Lane-major keeps the rows of lane i together, so that a traversal sweep
+ * over i = 0 .. s - 1 advances through the tables instead of jumping
+ * between 2^c blocks of s rows.
+ */
+enum mmcrypt_layout {
+	MMCRYPT_LAYOUT_ROW = 0,		/* [ka][i] */
+	MMCRYPT_LAYOUT_LANE,		/* [i][ka] */
+};
+
 struct mmcrypt_ctx {
 	duplexState sm;
+	spongeState ss;
+	int streaming;
+	enum mmcrypt_mempolicy mempolicy;
+	enum mmcrypt_layout layout;
+	int node;
+	mmcrypt_hook_t *hook;
+	void *hook_arg;
 };
 
 void mmcrypt_init(struct mmcrypt_ctx *ctx);
 
+void mmcrypt_set_hook(struct mmcrypt_ctx *ctx, mmcrypt_hook_t *hook, void *arg);
+
+void mmcrypt_set_mempolicy(struct mmcrypt_ctx *ctx,
+    enum mmcrypt_mempolicy policy);
+
+void mmcrypt_set_layout(struct mmcrypt_ctx *ctx, enum mmcrypt_layout layout);
+
+/*
+ * NUMA node backing the tables of the last stretch on ctx, pool jobs
+ * included, -1 if unknown or nothing was stretched yet.
+ */
+int mmcrypt_table_node(const struct mmcrypt_ctx *ctx);
+
 void mmcrypt_destroy(struct mmcrypt_ctx *ctx);
 
+/*
+ * Copy context state, e.g. to absorb a static prefix (pepper, service
+ * tag) once and start every request from a copy of it.  Restoring a
+ * snapshot is a clone in the opposite direction.
+ */
+void mmcrypt_ctx_clone(struct mmcrypt_ctx *dst, const struct mmcrypt_ctx *src);
+
+/* One duplex call, input fits in the 576-bit rate minus padding. */
+#define MMCRYPT_ABSORB_MAX	71
+
 int mmcrypt_absorb(struct mmcrypt_ctx *ctx, const void *data, size_t datalen);
 
+/*
+ * Streaming absorb of arbitrary length input.  Data passed to
+ * mmcrypt_absorb_update() between begin and final is hashed with
+ * Keccak[r=576, c=1024] and the 512-bit digest followed by a single 1 bit
+ * is absorbed into the context, which never collides with a byte aligned
+ * mmcrypt_absorb() input.  Other operations fail until final is called.
+ */
+int mmcrypt_absorb_begin(struct mmcrypt_ctx *ctx);
+
+int mmcrypt_absorb_update(struct mmcrypt_ctx *ctx, const void *data,
+    size_t datalen);
+
+int mmcrypt_absorb_final(struct mmcrypt_ctx *ctx);
+
+/*
+ * Absorb large in-memory input (e.g. a mmap'd keyfile) hashed with the
+ * parallel tree hash of mmcrypt-tree.h on up to 'threads' threads, 0 for
+ * all online CPUs.  The 512-bit digest followed by bits 0 and 1 is
+ * absorbed into the context, distinct from streaming absorb and from byte
+ * aligned mmcrypt_absorb() input.
+ */
+int mmcrypt_absorb_tree(struct mmcrypt_ctx *ctx, const void *data,
+    size_t datalen, int threads);
+
 int mmcrypt_squeeze(struct mmcrypt_ctx *ctx, void *key, size_t keylen);
 
+/*
+ * Squeeze keylen bytes with one empty duplex call per 576 bits, the same
+ * output as successive mmcrypt_squeeze() calls of 72 bytes.  keylen 0
+ * makes no call and leaves the state unchanged, unlike mmcrypt_squeeze()
+ * which always makes one.
+ */
+int mmcrypt_squeeze_long(struct mmcrypt_ctx *ctx, void *key, size_t keylen);
+
+#define MMCRYPT_LABEL_MAX	71
+
+/*
+ * Derive a labelled subkey without modifying the context: label followed
+ * by bits 1 1 is duplexed into a copy of ctx, then mmcrypt_squeeze_long().
+ * The odd input length keeps subkeys apart from mmcrypt_absorb() and
+ * mmcrypt_squeeze() output.  Label is 1 to MMCRYPT_LABEL_MAX bytes.
+ */
+int mmcrypt_derive(const struct mmcrypt_ctx *ctx, const char *label,
+    void *key, size_t keylen);
+
 int mmcrypt_stretch(struct mmcrypt_ctx *ctx, uint32_t iter, uint32_t c, uint32_t s);
 
+/*
+ * rounds selects the permutation of the s1 and s2 table fill duplexes: 0
+ * or 24 for Keccak-f[1600], 12 for Keccak-p[1600, 12] at about half the
+ * fill cost.  The main duplex always uses 24 rounds.  A reduced round count
+ * is absorbed with (iter, c, s) and gives different keys.
+ *
+ * width is the table row width in bytes, a power of 2 from 64 (0, the
+ * default) to 8192.  Every traversal step mixes whole rows, wider rows
+ * move more bytes per cache miss for the same number of steps and
+ * memsize grows with width.  Non-default widths give different keys.
+ */
+struct mmcrypt_params {
+	uint32_t iter;
+	uint32_t c;
+	uint32_t s;
+	uint32_t rounds;
+	uint32_t width;
+};
+
+#define MMCRYPT_ROUNDS_FULL	24
+#define MMCRYPT_ROUNDS_REDUCED	12
+
+#define MMCRYPT_WIDTH_MIN	64
+#define MMCRYPT_WIDTH_MAX	8192
+
+/* Bytes of table memory used by stretch, 0 if parameters are invalid. */
+size_t mmcrypt_memsize(const struct mmcrypt_params *p);
+
+/* mmcrypt_stretch() with all parameters, tables allocated internally. */
+int mmcrypt_stretch_params(struct mmcrypt_ctx *ctx,
+    const struct mmcrypt_params *p);
+
+/*
+ * mmcrypt_stretch() on caller provided, 8-byte aligned table memory of at
+ * least mmcrypt_memsize() bytes, e.g. reused by a worker thread between
+ * calls.  Memory is wiped before returning.
+ */
+int mmcrypt_stretch_mem(struct mmcrypt_ctx *ctx, const struct mmcrypt_params *p,
+    void *mem, size_t memlen);
+
+#if defined(__GNUC__)
+#pragma GCC visibility pop
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -0,0 +1,320 @@
+/*-
+ * Author: Gleb Kurtsou <gleb@FreeBSD.org>
+ *
+ * This software is hereby placed in the public domain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MMCRYPT_HPP_
+#define MMCRYPT_HPP_
+
+/*
+ * Header-only C++20 wrapper around the C interface.
+ *
+ * Context owns a struct mmcrypt_ctx by value and wipes it on destruction.
+ * It can be moved but not copied, clone() makes an explicit copy.
+ * Scratch owns table memory that stretch() reuses across calls, so a
+ * worker thread allocates only when parameters grow.  No call allocates
+ * more than the C function it wraps.
+ */
+
+#include <cstddef>
+#include <cstdlib>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#include "mmcrypt.h"
+
+namespace mmcrypt {
+
+enum class errc {
+	failed = 1,		/* C interface returned an error */
+	invalid_params,		/* invalid (iter, c, s, rounds) */
+	no_memory,		/* table memory allocation failed */
+};
+
+class error_category_impl : public std::error_category {
+public:
+	const char *name() const noexcept override
+	{
+		return "mmcrypt";
+	}
+
+	std::string message(int ev) const override
+	{
+		switch (static_cast<errc>(ev)) {
+		case errc::failed:
+			return "mmcrypt operation failed";
+		case errc::invalid_params:
+			return "invalid mmcrypt parameters";
+		case errc::no_memory:
+			return "cannot allocate mmcrypt table memory";
+		}
+		return "unknown mmcrypt error";
+	}
+};
+
+inline const std::error_category &
+error_category() noexcept
+{
+	static const error_category_impl category;
+
+	return category;
+}
+
+inline std::error_code
+make_error_code(errc e) noexcept
+{
+	return std::error_code(static_cast<int>(e), error_category());
+}
+
+} // namespace mmcrypt
+
+template <>
+struct std::is_error_code_enum<mmcrypt::errc> : std::true_type {};
+
+namespace mmcrypt {
+
+using Params = struct mmcrypt_params;
+
+namespace detail {
+
+inline std::error_code
+result(int rv) noexcept
+{
+	return rv == 0 ? std::error_code() : make_error_code(errc::failed);
+}
+
+} // namespace detail
+
+class Scratch {
+public:
+	static constexpr std::size_t alignment = 64;
+
+	Scratch() noexcept = default;
+
+	Scratch(const Scratch &) = delete;
+	Scratch &operator=(const Scratch &) = delete;
+
+	Scratch(Scratch &&other) noexcept
+	    : mem_(std::exchange(other.mem_, nullptr)),
+	      size_(std::exchange(other.size_, 0))
+	{
+	}
+
+	Scratch &operator=(Scratch &&other) noexcept
+	{
+		if (this != &other) {
+			release();
+			mem_ = std::exchange(other.mem_, nullptr);
+			size_ = std::exchange(other.size_, 0);
+		}
+		return *this;
+	}
+
+	~Scratch()
+	{
+		release();
+	}
+
+	/* Grow memory to fit stretch with given parameters. */
+	std::error_code reserve(const Params &p) noexcept
+	{
+		std::size_t size = mmcrypt_memsize(&p);
+
+		if (size == 0)
+			return make_error_code(errc::invalid_params);
+		if (size <= size_)
+			return {};
+		release();
+		size = (size + alignment - 1) / alignment * alignment;
+		mem_ = std::aligned_alloc(alignment, size);
+		if (mem_ == nullptr)
+			return make_error_code(errc::no_memory);
+		size_ = size;
+		return {};
+	}
+
+	void release() noexcept
+	{
+		/* Stretch wipes tables itself. */
+		std::free(mem_);
+		mem_ = nullptr;
+		size_ = 0;
+	}
+
+	void *data() const noexcept
+	{
+		return mem_;
+	}
+
+	std::size_t size() const noexcept
+	{
+		return size_;
+	}
+
+private:
+	void *mem_ = nullptr;
+	std::size_t size_ = 0;
+};
+
+class Context {
+public:
+	Context() noexcept
+	{
+		mmcrypt_init(&ctx_);
+	}
+
+	Context(const Context &) = delete;
+	Context &operator=(const Context &) = delete;
+
+	/* Moved from context is left freshly initialized. */
+	Context(Context &&other) noexcept
+	{
+		mmcrypt_ctx_clone(&ctx_, &other.ctx_);
+		other.reset();
+	}
+
+	Context &operator=(Context &&other) noexcept
+	{
+		if (this != &other) {
+			mmcrypt_ctx_clone(&ctx_, &other.ctx_);
+			other.reset();
+		}
+		return *this;
+	}
+
+	~Context()
+	{
+		mmcrypt_destroy(&ctx_);
+	}
+
+	void reset() noexcept
+	{
+		mmcrypt_destroy(&ctx_);
+		mmcrypt_init(&ctx_);
+	}
+
+	Context clone() const noexcept
+	{
+		Context c;
+
+		mmcrypt_ctx_clone(&c.ctx_, &ctx_);
+		return c;
+	}
+
+	void restore(const Context &snapshot) noexcept
+	{
+		mmcrypt_ctx_clone(&ctx_, &snapshot.ctx_);
+	}
+
+	std::error_code absorb(std::span<const std::byte> data) noexcept
+	{
+		return detail::result(mmcrypt_absorb(&ctx_, data.data(),
+		    data.size()));
+	}
+
+	std::error_code absorb(std::string_view data) noexcept
+	{
+		return absorb(std::as_bytes(std::span(data)));
+	}
+
+	std::error_code absorb_begin() noexcept
+	{
+		return detail::result(mmcrypt_absorb_begin(&ctx_));
+	}
+
+	std::error_code absorb_update(std::span<const std::byte> data) noexcept
+	{
+		return detail::result(mmcrypt_absorb_update(&ctx_, data.data(),
+		    data.size()));
+	}
+
+	std::error_code absorb_final() noexcept
+	{
+		return detail::result(mmcrypt_absorb_final(&ctx_));
+	}
+
+	std::error_code absorb_tree(std::span<const std::byte> data,
+	    int threads = 0) noexcept
+	{
+		return detail::result(mmcrypt_absorb_tree(&ctx_, data.data(),
+		    data.size(), threads));
+	}
+
+	/* At most 72 bytes, use squeeze_long() for more. */
+	std::error_code squeeze(std::span<std::byte> key) noexcept
+	{
+		return detail::result(mmcrypt_squeeze(&ctx_, key.data(),
+		    key.size()));
+	}
+
+	std::error_code squeeze_long(std::span<std::byte> key) noexcept
+	{
+		return detail::result(mmcrypt_squeeze_long(&ctx_, key.data(),
+		    key.size()));
+	}
+
+	/* Label must be NUL terminated, 1 to MMCRYPT_LABEL_MAX bytes. */
+	std::error_code derive(const char *label,
+	    std::span<std::byte> key) const noexcept
+	{
+		return detail::result(mmcrypt_derive(&ctx_, label, key.data(),
+		    key.size()));
+	}
+
+	/* Stretch with tables allocated and freed by the C library. */
+	std::error_code stretch(const Params &p) noexcept
+	{
+		if (mmcrypt_memsize(&p) == 0)
+			return make_error_code(errc::invalid_params);
+		return detail::result(mmcrypt_stretch_params(&ctx_, &p));
+	}
+
+	/* Stretch reusing scratch memory, grown if needed. */
+	std::error_code stretch(const Params &p, Scratch &scratch) noexcept
+	{
+		std::error_code ec = scratch.reserve(p);
+
+		if (ec)
+			return ec;
+		return detail::result(mmcrypt_stretch_mem(&ctx_, &p,
+		    scratch.data(), scratch.size()));
+	}
+
+	void set_hook(mmcrypt_hook_t *hook, void *arg) noexcept
+	{
+		mmcrypt_set_hook(&ctx_, hook, arg);
+	}
+
+	struct mmcrypt_ctx *native_handle() noexcept
+	{
+		return &ctx_;
+	}
+
+	const struct mmcrypt_ctx *native_handle() const noexcept
+	{
+		return &ctx_;
+	}
+
+private:
+	struct mmcrypt_ctx ctx_;
+};
+
+} // namespace mmcrypt
+
+#endif
@@ -0,0 +1,759 @@
+/*-
+ * Author: Gleb Kurtsou <gleb@FreeBSD.org>
+ *
+ * This software is hereby placed in the public domain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Local key derivation daemon.
+ *
+ * Requests arrive over a Unix domain socket (see mmcryptd.h), one thread
+ * per connection parses them and submits jobs to mmcrypt_pool, a fixed
+ * pool of worker threads pinned to CPUs.  Every worker keeps its table
+ * memory between jobs and only reallocates when a job needs more.
+ *
+ * Table memory of all workers is accounted against a global budget.
+ * A job larger than the budget is rejected, a job that does not fit at
+ * the moment waits while workers release their memory.  Requests beyond
+ * -q queued jobs are rejected as busy, so a login storm queues up to a
+ * bounded depth instead of exhausting memory.
+ *
+ * Statistics, including queue depth and wait, service and total latency
+ * histograms, are returned by MMCRYPTD_OP_STATS requests.
+ *
+ * Runs in foreground.  'mmcryptd stats' and 'mmcryptd derive ...' are
+ * client commands for testing and monitoring.
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#include <endian.h>
+#elif defined(__FreeBSD__)
+#include <sys/endian.h>
+#endif
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <err.h>
+#include <errno.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mmcrypt.h"
+#include "mmcrypt-pool.h"
+#include "mmcryptd.h"
+
+/* Latency buckets are powers of two microseconds, last one unbounded. */
+#define MMCRYPTD_HIST_BUCKETS	32
+
+enum mmcryptd_latency {
+	MMCRYPTD_LAT_WAIT = 0,
+	MMCRYPTD_LAT_SERVICE,
+	MMCRYPTD_LAT_TOTAL,
+	MMCRYPTD_LAT_MAX
+};
+
+struct mmcryptd_hist {
+	uint64_t bucket[MMCRYPTD_HIST_BUCKETS];
+	uint64_t count;
+	double sum;
+};
+
+struct mmcryptd_job {
+	struct mmcrypt_ctx ctx;
+	int status;
+	int done;
+	double submitted, started;
+	pthread_cond_t cv;
+};
+
+struct mmcryptd {
+	pthread_mutex_t lock;
+	struct mmcrypt_pool *pool;
+	struct mmcrypt_pool_config cfg;
+	uint32_t queue_peak;
+	int conns, conns_max;
+	uint64_t accepted, completed, failed;
+	uint64_t rejected_params, rejected_mem, rejected_busy;
+	struct mmcryptd_hist latency[MMCRYPTD_LAT_MAX];
+};
+
+static const char *mmcryptd_latency_names[MMCRYPTD_LAT_MAX] = {
+	[MMCRYPTD_LAT_WAIT] = "wait",
+	[MMCRYPTD_LAT_SERVICE] = "service",
+	[MMCRYPTD_LAT_TOTAL] = "total",
+};
+
+static const char *mmcryptd_status_names[] = {
+	[MMCRYPTD_OK] = "ok",
+	[MMCRYPTD_EPROTO] = "malformed request",
+	[MMCRYPTD_EPARAMS] = "invalid parameters",
+	[MMCRYPTD_EMEM] = "job exceeds memory budget",
+	[MMCRYPTD_EBUSY] = "queue is full",
+	[MMCRYPTD_EFAIL] = "derivation failed",
+};
+
+static struct mmcryptd mmcryptd = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static double
+mmcryptd_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+mmcryptd_hist_add(struct mmcryptd_hist *h, double sec)
+{
+	double usec = sec * 1e6;
+	int i;
+
+	for (i = 0; i < MMCRYPTD_HIST_BUCKETS - 1; i++)
+		if (usec <= (double)(1ULL << i))
+			break;
+	h->bucket[i]++;
+	h->count++;
+	h->sum += usec;
+}
+
+static void
+mmcryptd_hist_print(FILE *f, const char *name, const struct mmcryptd_hist *h)
+{
+	uint64_t n;
+	int i;
+
+	for (i = 0, n = 0; i < MMCRYPTD_HIST_BUCKETS - 1; i++) {
+		n += h->bucket[i];
+		fprintf(f, "latency_us_bucket{phase=\"%s\",le=\"%llu\"} %ju\n",
+		    name, 1ULL << i, (uintmax_t)n);
+	}
+	fprintf(f, "latency_us_bucket{phase=\"%s\",le=\"+Inf\"} %ju\n",
+	    name, (uintmax_t)h->count);
+	fprintf(f, "latency_us_sum{phase=\"%s\"} %.0lf\n", name, h->sum);
+	fprintf(f, "latency_us_count{phase=\"%s\"} %ju\n", name,
+	    (uintmax_t)h->count);
+}
+
+/* Service time starts when a worker begins stretching. */
+static void
+mmcryptd_job_hook(void *arg, enum mmcrypt_phase phase, int end)
+{
+	struct mmcryptd_job *job = arg;
+
+	if (phase == MMCRYPT_PHASE_STRETCH && !end)
+		job->started = mmcryptd_now();
+}
+
+static void
+mmcryptd_job_done(void *arg, struct mmcrypt_ctx *ctx, int status)
+{
+	struct mmcryptd *d = &mmcryptd;
+	struct mmcryptd_job *job = arg;
+	double end;
+
+	end = mmcryptd_now();
+	if (status != 0)
+		job->started = end;
+	pthread_mutex_lock(&d->lock);
+	if (status == 0)
+		d->completed++;
+	else
+		d->failed++;
+	mmcryptd_hist_add(&d->latency[MMCRYPTD_LAT_WAIT],
+	    job->started - job->submitted);
+	mmcryptd_hist_add(&d->latency[MMCRYPTD_LAT_SERVICE],
+	    end - job->started);
+	mmcryptd_hist_add(&d->latency[MMCRYPTD_LAT_TOTAL],
+	    end - job->submitted);
+	job->status = status == 0 ? MMCRYPTD_OK : MMCRYPTD_EFAIL;
+	job->done = 1;
+	pthread_cond_signal(&job->cv);
+	pthread_mutex_unlock(&d->lock);
+}
+
+static int
+mmcryptd_submit(struct mmcryptd_job *job, const struct mmcrypt_params *p)
+{
+	struct mmcryptd *d = &mmcryptd;
+	struct mmcrypt_pool_stats st;
+	int rv;
+
+	job->done = 0;
+	job->submitted = mmcryptd_now();
+	mmcrypt_set_hook(&job->ctx, mmcryptd_job_hook, job);
+	rv = mmcrypt_pool_submit(d->pool, &job->ctx, p, mmcryptd_job_done,
+	    job);
+	if (rv == 0)
+		mmcrypt_pool_stats(d->pool, &st);
+	pthread_mutex_lock(&d->lock);
+	switch (rv) {
+	case 0:
+		d->accepted++;
+		if (st.queued > d->queue_peak)
+			d->queue_peak = st.queued;
+		while (!job->done)
+			pthread_cond_wait(&job->cv, &d->lock);
+		break;
+	case EINVAL:
+		d->rejected_params++;
+		job->status = MMCRYPTD_EPARAMS;
+		break;
+	case E2BIG:
+		d->rejected_mem++;
+		job->status = MMCRYPTD_EMEM;
+		break;
+	case EAGAIN:
+		d->rejected_busy++;
+		job->status = MMCRYPTD_EBUSY;
+		break;
+	default:
+		job->status = MMCRYPTD_EFAIL;
+		break;
+	}
+	pthread_mutex_unlock(&d->lock);
+	return job->status;
+}
+
+static char *
+mmcryptd_stats(size_t *lenp)
+{
+	struct mmcryptd *d = &mmcryptd;
+	struct mmcrypt_pool_stats st;
+	char *buf = NULL;
+	FILE *f;
+	int i;
+
+	f = open_memstream(&buf, lenp);
+	if (f == NULL)
+		return NULL;
+	mmcrypt_pool_stats(d->pool, &st);
+	pthread_mutex_lock(&d->lock);
+	fprintf(f, "workers %u\n", st.workers);
+	fprintf(f, "connections %d\n", d->conns);
+	fprintf(f, "memory_budget_bytes %zu\n", st.mem_max);
+	fprintf(f, "memory_used_bytes %zu\n", st.mem_used);
+	fprintf(f, "queue_depth %u\n", st.queued);
+	fprintf(f, "queue_peak %u\n", d->queue_peak);
+	fprintf(f, "queue_max %u\n", d->cfg.queue_max);
+	fprintf(f, "jobs_running %u\n", st.running);
+	fprintf(f, "jobs_stolen %ju\n", (uintmax_t)st.stolen);
+	fprintf(f, "jobs_bypassed %ju\n", (uintmax_t)st.bypassed);
+	fprintf(f, "numa_nodes %u\n", st.nodes);
+	for (i = 0; i < MMCRYPT_NUMA_NODES_MAX; i++)
+		if (st.node_jobs[i] != 0)
+			fprintf(f, "jobs_node{node=\"%d\"} %ju\n", i,
+			    (uintmax_t)st.node_jobs[i]);
+	fprintf(f, "jobs_remote_node %ju\n", (uintmax_t)st.remote);
+	fprintf(f, "jobs_accepted %ju\n", (uintmax_t)d->accepted);
+	fprintf(f, "jobs_completed %ju\n", (uintmax_t)d->completed);
+	fprintf(f, "jobs_failed %ju\n", (uintmax_t)d->failed);
+	fprintf(f, "rejected_params %ju\n", (uintmax_t)d->rejected_params);
+	fprintf(f, "rejected_memory %ju\n", (uintmax_t)d->rejected_mem);
+	fprintf(f, "rejected_busy %ju\n", (uintmax_t)d->rejected_busy);
+	for (i = 0; i < MMCRYPTD_LAT_MAX; i++)
+		mmcryptd_hist_print(f, mmcryptd_latency_names[i],
+		    &d->latency[i]);
+	pthread_mutex_unlock(&d->lock);
+	if (fclose(f) != 0) {
+		free(buf);
+		return NULL;
+	}
+	return buf;
+}
+
+static int
+mmcryptd_read(int fd, void *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = read(fd, buf, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return 1;
+		buf = (uint8_t *)buf + n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int
+mmcryptd_write(int fd, const void *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, buf, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return 1;
+		buf = (const uint8_t *)buf + n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int
+mmcryptd_reply(int fd, int status, const void *data, uint32_t len)
+{
+	struct {
+		uint32_t framelen;
+		struct mmcryptd_reply reply;
+	} hdr;
+
+	hdr.framelen = htobe32(sizeof(hdr.reply) + len);
+	hdr.reply.status = htobe32(status);
+	hdr.reply.len = htobe32(len);
+	if (mmcryptd_write(fd, &hdr, sizeof(hdr)) != 0)
+		return 1;
+	return len == 0 ? 0 : mmcryptd_write(fd, data, len);
+}
+
+/* Absorb a request field, streaming it if it is too long for one call. */
+static int
+mmcryptd_absorb(struct mmcrypt_ctx *ctx, const uint8_t *data, size_t len)
+{
+	if (len <= MMCRYPT_ABSORB_MAX)
+		return mmcrypt_absorb(ctx, data, len);
+	if (mmcrypt_absorb_begin(ctx) != 0 ||
+	    mmcrypt_absorb_update(ctx, data, len) != 0)
+		return 1;
+	return mmcrypt_absorb_final(ctx);
+}
+
+static int
+mmcryptd_handle(int fd, uint8_t *frame, uint32_t len, uint8_t *key)
+{
+	struct mmcryptd *d = &mmcryptd;
+	struct mmcryptd_request req;
+	struct mmcryptd_job job;
+	struct mmcrypt_params p;
+	uint32_t keylen, saltlen, passlen;
+	char *stats;
+	size_t statslen;
+	int rv, status;
+
+	if (len < sizeof(req))
+		return mmcryptd_reply(fd, MMCRYPTD_EPROTO, NULL, 0);
+	memcpy(&req, frame, sizeof(req));
+	switch (be32toh(req.op)) {
+	case MMCRYPTD_OP_STATS:
+		stats = mmcryptd_stats(&statslen);
+		if (stats == NULL)
+			return mmcryptd_reply(fd, MMCRYPTD_EFAIL, NULL, 0);
+		rv = mmcryptd_reply(fd, MMCRYPTD_OK, stats, statslen);
+		free(stats);
+		return rv;
+	case MMCRYPTD_OP_DERIVE:
+		break;
+	default:
+		return mmcryptd_reply(fd, MMCRYPTD_EPROTO, NULL, 0);
+	}
+
+	p.iter = be32toh(req.iter);
+	p.c = be32toh(req.c);
+	p.s = be32toh(req.s);
+	p.rounds = 0;
+	p.width = 0;
+	keylen = be32toh(req.keylen);
+	saltlen = be32toh(req.saltlen);
+	passlen = be32toh(req.passlen);
+	if ((uint64_t)saltlen + passlen != len - sizeof(req))
+		return mmcryptd_reply(fd, MMCRYPTD_EPROTO, NULL, 0);
+	if (keylen == 0 || keylen > MMCRYPTD_KEY_MAX) {
+		pthread_mutex_lock(&d->lock);
+		d->rejected_params++;
+		pthread_mutex_unlock(&d->lock);
+		return mmcryptd_reply(fd, MMCRYPTD_EPARAMS, NULL, 0);
+	}
+	mmcrypt_init(&job.ctx);
+	rv = mmcryptd_absorb(&job.ctx, frame + sizeof(req), saltlen);
+	rv |= mmcryptd_absorb(&job.ctx, frame + sizeof(req) + saltlen, passlen);
+	if (rv != 0) {
+		pthread_mutex_lock(&d->lock);
+		d->failed++;
+		pthread_mutex_unlock(&d->lock);
+		status = MMCRYPTD_EFAIL;
+	} else {
+		pthread_cond_init(&job.cv, NULL);
+		status = mmcryptd_submit(&job, &p);
+		pthread_cond_destroy(&job.cv);
+	}
+	if (status == MMCRYPTD_OK &&
+	    mmcrypt_squeeze_long(&job.ctx, key, keylen) != 0)
+		status = MMCRYPTD_EFAIL;
+	mmcrypt_destroy(&job.ctx);
+	if (status != MMCRYPTD_OK)
+		return mmcryptd_reply(fd, status, NULL, 0);
+	rv = mmcryptd_reply(fd, status, key, keylen);
+	memset(key, 0, keylen);
+	return rv;
+}
+
+static void *
+mmcryptd_conn_main(void *arg)
+{
+	struct mmcryptd *d = &mmcryptd;
+	uint8_t *frame, *key;
+	uint32_t len;
+	int fd = (int)(intptr_t)arg;
+
+	frame = malloc(MMCRYPTD_FRAME_MAX);
+	key = malloc(MMCRYPTD_KEY_MAX);
+	while (frame != NULL && key != NULL) {
+		if (mmcryptd_read(fd, &len, sizeof(len)) != 0)
+			break;
+		len = be32toh(len);
+		if (len > MMCRYPTD_FRAME_MAX) {
+			mmcryptd_reply(fd, MMCRYPTD_EPROTO, NULL, 0);
+			break;
+		}
+		if (mmcryptd_read(fd, frame, len) != 0)
+			break;
+		if (mmcryptd_handle(fd, frame, len, key) != 0)
+			break;
+		/* Password is not kept around. */
+		memset(frame, 0, len);
+	}
+	free(frame);
+	free(key);
+	close(fd);
+	pthread_mutex_lock(&d->lock);
+	d->conns--;
+	pthread_mutex_unlock(&d->lock);
+	return NULL;
+}
+
+static int
+mmcryptd_sockaddr(struct sockaddr_un *sun, const char *path)
+{
+	memset(sun, 0, sizeof(*sun));
+	sun->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(sun->sun_path)) {
+		errno = ENAMETOOLONG;
+		return 1;
+	}
+	strcpy(sun->sun_path, path);
+	return 0;
+}
+
+static int
+mmcryptd_connect(const char *path)
+{
+	struct sockaddr_un sun;
+	int fd;
+
+	if (mmcryptd_sockaddr(&sun, path) != 0)
+		return -1;
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * Refuse a socket directory another user could plant the socket in:
+ * it must be ours and writable by nobody else.  The default one is
+ * created if missing.
+ */
+static void
+mmcryptd_check_dir(const char *path)
+{
+	struct stat sb;
+	char *copy, *dir;
+
+	copy = strdup(path);
+	if (copy == NULL)
+		err(1, "strdup");
+	dir = dirname(copy);
+	if (strcmp(path, MMCRYPTD_SOCKET) == 0 &&
+	    mkdir(dir, 0700) != 0 && errno != EEXIST)
+		err(1, "mkdir %s", dir);
+	if (lstat(dir, &sb) != 0)
+		err(1, "%s", dir);
+	if (!S_ISDIR(sb.st_mode))
+		errx(1, "%s: not a directory", dir);
+	if (sb.st_uid != geteuid())
+		errx(1, "%s: not owned by uid %u", dir, (unsigned)geteuid());
+	if ((sb.st_mode & (S_IWGRP | S_IWOTH)) != 0)
+		errx(1, "%s: writable by group or others", dir);
+	free(copy);
+}
+
+static int
+mmcryptd_listen(const char *path, mode_t mode)
+{
+	struct sockaddr_un sun;
+	struct stat sb;
+	int fd, cfd;
+
+	if (mmcryptd_sockaddr(&sun, path) != 0)
+		err(1, "%s", path);
+	mmcryptd_check_dir(path);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		err(1, "socket");
+	if (bind(fd, (struct sockaddr *)&sun, sizeof(sun)) != 0) {
+		if (errno != EADDRINUSE)
+			err(1, "bind %s", path);
+		/* Remove stale socket unless another daemon is listening. */
+		cfd = mmcryptd_connect(path);
+		if (cfd >= 0)
+			errx(1, "%s: mmcryptd is already running", path);
+		if (lstat(path, &sb) != 0)
+			err(1, "%s", path);
+		if (!S_ISSOCK(sb.st_mode) || sb.st_uid != geteuid())
+			errx(1, "%s: not our socket, not removing", path);
+		if (unlink(path) != 0 ||
+		    bind(fd, (struct sockaddr *)&sun, sizeof(sun)) != 0)
+			err(1, "bind %s", path);
+	}
+	if (chmod(path, mode) != 0)
+		err(1, "chmod %s", path);
+	if (listen(fd, SOMAXCONN) != 0)
+		err(1, "listen");
+	return fd;
+}
+
+static void *
+mmcryptd_accept_main(void *arg)
+{
+	struct mmcryptd *d = &mmcryptd;
+	pthread_attr_t attr;
+	pthread_t td;
+	int fd, lfd = (int)(intptr_t)arg;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	for (;;) {
+		fd = accept(lfd, NULL, NULL);
+		if (fd < 0) {
+			if (errno != EINTR && errno != ECONNABORTED)
+				warn("accept");
+			continue;
+		}
+		pthread_mutex_lock(&d->lock);
+		if (d->conns >= d->conns_max) {
+			pthread_mutex_unlock(&d->lock);
+			close(fd);
+			continue;
+		}
+		d->conns++;
+		pthread_mutex_unlock(&d->lock);
+		if (pthread_create(&td, &attr, mmcryptd_conn_main,
+		    (void *)(intptr_t)fd) != 0) {
+			warnx("pthread_create failed");
+			close(fd);
+			pthread_mutex_lock(&d->lock);
+			d->conns--;
+			pthread_mutex_unlock(&d->lock);
+		}
+	}
+	/* NOTREACHED */
+	return NULL;
+}
+
+static int
+mmcryptd_request(int fd, const struct mmcryptd_request *req,
+    const void *data, uint32_t datalen, struct mmcryptd_reply *reply,
+    uint8_t **payload)
+{
+	uint32_t framelen;
+
+	framelen = htobe32(sizeof(*req) + datalen);
+	if (mmcryptd_write(fd, &framelen, sizeof(framelen)) != 0 ||
+	    mmcryptd_write(fd, req, sizeof(*req)) != 0 ||
+	    mmcryptd_write(fd, data, datalen) != 0)
+		return 1;
+	if (mmcryptd_read(fd, &framelen, sizeof(framelen)) != 0 ||
+	    mmcryptd_read(fd, reply, sizeof(*reply)) != 0)
+		return 1;
+	reply->status = be32toh(reply->status);
+	reply->len = be32toh(reply->len);
+	if (be32toh(framelen) != sizeof(*reply) + reply->len ||
+	    reply->len > MMCRYPTD_FRAME_MAX)
+		return 1;
+	*payload = malloc(reply->len + 1);
+	if (*payload == NULL || mmcryptd_read(fd, *payload, reply->len) != 0)
+		return 1;
+	(*payload)[reply->len] = '\0';
+	return 0;
+}
+
+static int
+mmcryptd_client(const char *path, int argc, char **argv)
+{
+	struct mmcryptd_request req;
+	struct mmcryptd_reply reply;
+	uint8_t *data, *payload = NULL;
+	size_t saltlen, passlen;
+	uint32_t i;
+	int fd;
+
+	memset(&req, 0, sizeof(req));
+	data = NULL;
+	saltlen = passlen = 0;
+	if (argc == 1 && strcmp(argv[0], "stats") == 0)
+		req.op = htobe32(MMCRYPTD_OP_STATS);
+	else if (argc == 7 && strcmp(argv[0], "derive") == 0) {
+		req.op = htobe32(MMCRYPTD_OP_DERIVE);
+		req.iter = htobe32(strtoul(argv[1], NULL, 0));
+		req.c = htobe32(strtoul(argv[2], NULL, 0));
+		req.s = htobe32(strtoul(argv[3], NULL, 0));
+		req.keylen = htobe32(strtoul(argv[4], NULL, 0));
+		saltlen = strlen(argv[5]);
+		passlen = strlen(argv[6]);
+		if (saltlen + passlen > MMCRYPTD_FRAME_MAX - sizeof(req))
+			errx(1, "salt and password are too long");
+		req.saltlen = htobe32(saltlen);
+		req.passlen = htobe32(passlen);
+		data = malloc(saltlen + passlen + 1);
+		if (data == NULL)
+			err(1, "malloc");
+		memcpy(data, argv[5], saltlen);
+		memcpy(data + saltlen, argv[6], passlen);
+	} else
+		return -1;
+
+	fd = mmcryptd_connect(path);
+	if (fd < 0)
+		err(1, "%s", path);
+	if (mmcryptd_request(fd, &req, data, saltlen + passlen, &reply,
+	    &payload) != 0)
+		errx(1, "%s: protocol error", path);
+	close(fd);
+	free(data);
+	if (reply.status != MMCRYPTD_OK) {
+		warnx("%s", reply.status < sizeof(mmcryptd_status_names) /
+		    sizeof(mmcryptd_status_names[0]) ?
+		    mmcryptd_status_names[reply.status] : "unknown error");
+		free(payload);
+		return 1;
+	}
+	if (req.op == htobe32(MMCRYPTD_OP_STATS))
+		fputs((char *)payload, stdout);
+	else {
+		for (i = 0; i < reply.len; i++)
+			printf("%02X", payload[i]);
+		printf("\n");
+	}
+	free(payload);
+	return 0;
+}
+
+static void
+usage(const char *prog)
+{
+	fprintf(stderr,
+	    "usage: %s [-P] [-S socket] [-M mode] [-w workers] "
+	    "[-m budget-MiB]\n"
+	    "       [-q queue-max] [-n max-connections]\n"
+	    "       %s [-S socket] stats\n"
+	    "       %s [-S socket] derive iter c s keylen salt password\n",
+	    prog, prog, prog);
+	exit(-1);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct mmcryptd *d = &mmcryptd;
+	const char *prog = basename(argv[0]);
+	const char *path = MMCRYPTD_SOCKET;
+	pthread_t accept_td;
+	sigset_t sigs;
+	mode_t mode = 0660;
+	int ch, lfd, rv, sig;
+
+	d->cfg.pin = 1;
+	d->cfg.mem_max = (size_t)1024 << 20;
+	d->cfg.queue_max = 1024;
+	d->conns_max = 256;
+	while ((ch = getopt(argc, argv, "M:PS:m:n:q:w:")) != -1) {
+		switch (ch) {
+		case 'M':
+			mode = strtoul(optarg, NULL, 8);
+			break;
+		case 'P':
+			d->cfg.pin = 0;
+			break;
+		case 'S':
+			path = optarg;
+			break;
+		case 'm':
+			d->cfg.mem_max = (size_t)strtoull(optarg, NULL, 0) << 20;
+			break;
+		case 'n':
+			d->conns_max = atoi(optarg);
+			break;
+		case 'q':
+			d->cfg.queue_max = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			d->cfg.workers = atoi(optarg);
+			break;
+		default:
+			usage(prog);
+		}
+	}
+	signal(SIGPIPE, SIG_IGN);
+	if (optind != argc) {
+		rv = mmcryptd_client(path, argc - optind, argv + optind);
+		if (rv < 0)
+			usage(prog);
+		return rv;
+	}
+	if (d->cfg.workers < 0 || d->conns_max < 1 || d->cfg.mem_max == 0 ||
+	    d->cfg.queue_max == 0)
+		usage(prog);
+
+	/* Only main thread handles termination signals. */
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGINT);
+	sigaddset(&sigs, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+
+	lfd = mmcryptd_listen(path, mode);
+	d->pool = mmcrypt_pool_create(&d->cfg);
+	if (d->pool == NULL)
+		errx(1, "mmcrypt_pool_create failed");
+	if (pthread_create(&accept_td, NULL, mmcryptd_accept_main,
+	    (void *)(intptr_t)lfd) != 0)
+		errx(1, "pthread_create failed");
+	fprintf(stderr, "%s: listening on %s, budget %zu MiB\n",
+	    prog, path, d->cfg.mem_max >> 20);
+
+	sigwait(&sigs, &sig);
+	unlink(path);
+	return 0;
+}
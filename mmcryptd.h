@@ -0,0 +1,80 @@
+/*-
+ * Author: Gleb Kurtsou <gleb@FreeBSD.org>
+ *
+ * This software is hereby placed in the public domain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MMCRYPTD_H_
+#define MMCRYPTD_H_
+
+#include <stdint.h>
+
+/*
+ * mmcryptd wire protocol.
+ *
+ * Every message is a frame: 32-bit big-endian payload length followed by
+ * the payload.  Request payload is struct mmcryptd_request followed by
+ * saltlen bytes of salt and passlen bytes of password.  Key is
+ * mmcrypt_squeeze_long() output after absorbing salt and password and
+ * stretching with (iter, c, s).  A field of up to MMCRYPT_ABSORB_MAX bytes
+ * is absorbed with mmcrypt_absorb(), a longer one, up to the frame size,
+ * with mmcrypt_absorb_begin(), _update() and _final().
+ *
+ * Reply payload is struct mmcryptd_reply followed by keylen bytes of key
+ * for MMCRYPTD_OP_DERIVE or statistics text for MMCRYPTD_OP_STATS.
+ * All integers are big-endian.  A connection may carry any number of
+ * requests, each is answered before the next one is read.
+ */
+
+/*
+ * Requests carry passwords: the socket lives in a directory owned by the
+ * daemon's user and writable by nobody else.  The default directory is
+ * created mode 0700.
+ */
+#define MMCRYPTD_SOCKET_DIR	"/run/mmcryptd"
+#define MMCRYPTD_SOCKET		MMCRYPTD_SOCKET_DIR "/mmcryptd.sock"
+#define MMCRYPTD_FRAME_MAX	(128 * 1024)
+#define MMCRYPTD_KEY_MAX	4096
+
+enum mmcryptd_op {
+	MMCRYPTD_OP_DERIVE = 1,
+	MMCRYPTD_OP_STATS,
+};
+
+enum mmcryptd_status {
+	MMCRYPTD_OK = 0,
+	MMCRYPTD_EPROTO,		/* malformed request */
+	MMCRYPTD_EPARAMS,		/* invalid (iter, c, s) or keylen */
+	MMCRYPTD_EMEM,			/* job exceeds memory budget */
+	MMCRYPTD_EBUSY,			/* queue is full, retry later */
+	MMCRYPTD_EFAIL,			/* allocation or stretch failed */
+};
+
+struct mmcryptd_request {
+	uint32_t op;
+	uint32_t iter;
+	uint32_t c;
+	uint32_t s;
+	uint32_t keylen;
+	uint32_t saltlen;
+	uint32_t passlen;
+};
+
+struct mmcryptd_reply {
+	uint32_t status;
+	uint32_t len;
+};
+
+#endif